@@ -0,0 +1,319 @@
+/*
+ * bignum.c - big integers for the Fibonacci numbers
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bignum.h"
+
+/* below this number of limbs schoolbook multiplication is faster */
+#define KARATSUBA_THRESHOLD	48
+
+int bn_init(struct bignum *a, size_t size)
+{
+	a->len = 0;
+	a->size = size ? size : 1;
+	a->limb = malloc(a->size * sizeof(*a->limb));
+
+	return a->limb ? 0 : -1;
+}
+
+void bn_free(struct bignum *a)
+{
+	free(a->limb);
+	a->limb = NULL;
+	a->len = a->size = 0;
+}
+
+static int bn_reserve(struct bignum *a, size_t size)
+{
+	uint32_t *limb;
+
+	if (size <= a->size)
+		return 0;
+
+	if (size < 2 * a->size)
+		size = 2 * a->size;
+
+	limb = realloc(a->limb, size * sizeof(*limb));
+	if (!limb)
+		return -1;
+
+	a->limb = limb;
+	a->size = size;
+	return 0;
+}
+
+static void bn_normalize(struct bignum *a)
+{
+	while (a->len && !a->limb[a->len - 1])
+		a->len--;
+}
+
+int bn_set(struct bignum *a, uint32_t val)
+{
+	if (bn_reserve(a, 2))
+		return -1;
+
+	a->limb[0] = val % BN_BASE;
+	a->limb[1] = val / BN_BASE;
+	a->len = 2;
+	bn_normalize(a);
+	return 0;
+}
+
+void bn_swap(struct bignum *a, struct bignum *b)
+{
+	struct bignum tmp = *a;
+
+	*a = *b;
+	*b = tmp;
+}
+
+int bn_add(struct bignum *r, const struct bignum *a, const struct bignum *b)
+{
+	size_t len = a->len > b->len ? a->len : b->len;
+	uint32_t carry = 0;
+	size_t i;
+
+	if (bn_reserve(r, len + 1))
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		uint32_t s = carry;
+
+		if (i < a->len)
+			s += a->limb[i];
+		if (i < b->len)
+			s += b->limb[i];
+
+		carry = s >= BN_BASE;
+		r->limb[i] = carry ? s - BN_BASE : s;
+	}
+
+	r->limb[len] = carry;
+	r->len = len + 1;
+	bn_normalize(r);
+	return 0;
+}
+
+int bn_sub(struct bignum *r, const struct bignum *a, const struct bignum *b)
+{
+	uint32_t borrow = 0;
+	size_t i;
+
+	if (bn_reserve(r, a->len))
+		return -1;
+
+	for (i = 0; i < a->len; i++) {
+		uint32_t s = b->len > i ? b->limb[i] + borrow : borrow;
+		uint32_t d = a->limb[i];
+
+		borrow = d < s;
+		r->limb[i] = borrow ? d + BN_BASE - s : d - s;
+	}
+
+	r->len = a->len;
+	bn_normalize(r);
+	return 0;
+}
+
+/* r[0, an + bn) = a * b */
+static void mul_school(uint32_t *r, const uint32_t *a, size_t an,
+		       const uint32_t *b, size_t bn)
+{
+	size_t i, j;
+
+	memset(r, 0, (an + bn) * sizeof(*r));
+
+	for (i = 0; i < an; i++) {
+		uint64_t carry = 0;
+
+		for (j = 0; j < bn; j++) {
+			uint64_t t = r[i + j] + (uint64_t)a[i] * b[j] + carry;
+
+			r[i + j] = t % BN_BASE;
+			carry = t / BN_BASE;
+		}
+		r[i + bn] = carry;
+	}
+}
+
+/* r[0, n) += a[0, an), the carry out of r is dropped */
+static void add_to(uint32_t *r, size_t n, const uint32_t *a, size_t an)
+{
+	uint32_t carry = 0;
+	size_t i;
+
+	for (i = 0; i < n && (i < an || carry); i++) {
+		uint32_t s = r[i] + carry + (i < an ? a[i] : 0);
+
+		carry = s >= BN_BASE;
+		r[i] = carry ? s - BN_BASE : s;
+	}
+}
+
+/* r[0, n) -= a[0, an), r must be >= a */
+static void sub_from(uint32_t *r, size_t n, const uint32_t *a, size_t an)
+{
+	uint32_t borrow = 0;
+	size_t i;
+
+	for (i = 0; i < n && (i < an || borrow); i++) {
+		uint32_t s = borrow + (i < an ? a[i] : 0);
+
+		borrow = r[i] < s;
+		r[i] = borrow ? r[i] + BN_BASE - s : r[i] - s;
+	}
+}
+
+static size_t kara_scratch(size_t n)
+{
+	size_t h2 = n - n / 2;
+
+	if (n < KARATSUBA_THRESHOLD)
+		return 0;
+
+	/* a0 + a1, b0 + b1, their product and the scratch of it */
+	return 4 * (h2 + 1) + kara_scratch(h2 + 1);
+}
+
+/*
+ * Karatsuba: with a = a1 B^h + a0 and b = b1 B^h + b0
+ *
+ *   a b = a1 b1 B^2h + ((a0 + a1)(b0 + b1) - a0 b0 - a1 b1) B^h + a0 b0
+ *
+ * r[0, 2n) = a[0, n) * b[0, n)
+ */
+static void mul_kara(uint32_t *r, const uint32_t *a, const uint32_t *b,
+		     size_t n, uint32_t *tmp)
+{
+	size_t h = n / 2, h2 = n - h;
+	uint32_t *sa, *sb, *z1;
+
+	if (n < KARATSUBA_THRESHOLD) {
+		mul_school(r, a, n, b, n);
+		return;
+	}
+
+	sa = tmp;
+	sb = sa + h2 + 1;
+	z1 = sb + h2 + 1;
+	tmp = z1 + 2 * (h2 + 1);
+
+	memcpy(sa, a + h, h2 * sizeof(*sa));
+	sa[h2] = 0;
+	add_to(sa, h2 + 1, a, h);
+
+	memcpy(sb, b + h, h2 * sizeof(*sb));
+	sb[h2] = 0;
+	add_to(sb, h2 + 1, b, h);
+
+	mul_kara(z1, sa, sb, h2 + 1, tmp);
+
+	mul_kara(r, a, b, h, tmp);
+	mul_kara(r + 2 * h, a + h, b + h, h2, tmp);
+
+	sub_from(z1, 2 * (h2 + 1), r, 2 * h);
+	sub_from(z1, 2 * (h2 + 1), r + 2 * h, 2 * h2);
+
+	/* the limbs of z1 beyond the product length are zero */
+	add_to(r + h, 2 * n - h, z1, 2 * (h2 + 1));
+}
+
+int bn_mul(struct bignum *r, const struct bignum *a, const struct bignum *b)
+{
+	size_t n = a->len > b->len ? a->len : b->len;
+	size_t m = a->len < b->len ? a->len : b->len;
+	uint32_t *pa, *pb, *tmp;
+
+	if (!m) {
+		r->len = 0;
+		return 0;
+	}
+
+	if (bn_reserve(r, 2 * n))
+		return -1;
+
+	if (m < KARATSUBA_THRESHOLD) {
+		mul_school(r->limb, a->limb, a->len, b->limb, b->len);
+		r->len = a->len + b->len;
+		bn_normalize(r);
+		return 0;
+	}
+
+	/* pad the shorter one with zeros to the same length */
+	tmp = malloc((n + kara_scratch(n)) * sizeof(*tmp));
+	if (!tmp)
+		return -1;
+
+	pa = a->limb;
+	pb = b->limb;
+	if (a->len < n) {
+		memcpy(tmp, a->limb, a->len * sizeof(*tmp));
+		memset(tmp + a->len, 0, (n - a->len) * sizeof(*tmp));
+		pa = tmp;
+	} else if (b->len < n) {
+		memcpy(tmp, b->limb, b->len * sizeof(*tmp));
+		memset(tmp + b->len, 0, (n - b->len) * sizeof(*tmp));
+		pb = tmp;
+	}
+
+	mul_kara(r->limb, pa, pb, n, tmp + n);
+	free(tmp);
+
+	r->len = 2 * n;
+	bn_normalize(r);
+	return 0;
+}
+
+size_t bn_digits(const struct bignum *a)
+{
+	uint32_t top;
+	size_t n;
+
+	if (!a->len)
+		return 1;
+
+	n = (a->len - 1) * BN_DIGITS;
+	for (top = a->limb[a->len - 1]; top; top /= 10)
+		n++;
+
+	return n;
+}
+
+/* the decimal string, to be freed by the caller */
+char *bn_to_str(const struct bignum *a)
+{
+	size_t len = bn_digits(a);
+	char *str, *p;
+	size_t i;
+
+	str = malloc(len + 1);
+	if (!str)
+		return NULL;
+
+	p = str + len;
+	*p = '\0';
+
+	if (!a->len) {
+		*--p = '0';
+		return str;
+	}
+
+	for (i = 0; i + 1 < a->len; i++) {
+		uint32_t v = a->limb[i];
+		int d;
+
+		for (d = 0; d < BN_DIGITS; d++) {
+			*--p = '0' + v % 10;
+			v /= 10;
+		}
+	}
+
+	for (i = a->limb[a->len - 1]; i; i /= 10)
+		*--p = '0' + i % 10;
+
+	return str;
+}
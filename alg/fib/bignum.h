@@ -0,0 +1,35 @@
+#ifndef __BIGNUM_H
+#define __BIGNUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Non-negative big integer with 10^9 limbs, least significant first, so
+ * the decimal output is just printing the limbs. Zero has len 0.
+ */
+#define BN_BASE		1000000000U
+#define BN_DIGITS	9
+
+struct bignum {
+	uint32_t *limb;
+	size_t len;
+	size_t size;
+};
+
+int bn_init(struct bignum *a, size_t size);
+void bn_free(struct bignum *a);
+int bn_set(struct bignum *a, uint32_t val);
+void bn_swap(struct bignum *a, struct bignum *b);
+
+/* r may be the same as a or b */
+int bn_add(struct bignum *r, const struct bignum *a, const struct bignum *b);
+/* r = a - b, a must be >= b, r may be the same as a or b */
+int bn_sub(struct bignum *r, const struct bignum *a, const struct bignum *b);
+/* r must not be the same as a or b */
+int bn_mul(struct bignum *r, const struct bignum *a, const struct bignum *b);
+
+size_t bn_digits(const struct bignum *a);
+char *bn_to_str(const struct bignum *a);
+
+#endif /* __BIGNUM_H */
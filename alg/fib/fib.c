@@ -1,37 +1,146 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fibonacci.h"
 
 #define MIN_NUM 0
-#define MAX_NUM 1000
 
-static int fib(int n)
+#define NSEC_IN_SEC	1000000000ULL
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static int print_fib(uint64_t n)
 {
-	int F[MAX_NUM + 1];
-	int i;
+	struct bignum f = { 0 };
+	char *str;
+
+	if (n < FIB_TABLE_SIZE) {
+		printf("%llu\n", (unsigned long long)fib_u64(n));
+		return 0;
+	}
+
+	if (fib_fast(&f, n) || !(str = bn_to_str(&f))) {
+		fprintf(stderr, "Out of memory\n");
+		bn_free(&f);
+		return -1;
+	}
+
+	puts(str);
+
+	free(str);
+	bn_free(&f);
+	return 0;
+}
 
-	F[0] = 0;
-	F[1] = 1;
-	F[2] = 1;
+/* the matrices are only needed if n does not fit into 64 bits */
+static int fib_mod_query(const char *n, uint64_t m, uint64_t *r)
+{
+	unsigned long long val;
+	char *end;
 
-	for (i = 3; i <= n; i++)
-		F[i] = F[i - 2] + F[i - 1];
+	errno = 0;
+	val = strtoull(n, &end, 10);
+	if (*end || errno || *n == '-')
+		return fib_mod_str(n, m, r);
 
-	return F[n];
+	*r = fib_mod(val, m);
+	return 0;
+}
+
+/*
+ * A query per line: "n" prints F(n), "n m" prints F(n) mod m where n may
+ * have any number of digits.
+ */
+static int batch(void)
+{
+	size_t nr_queries = 0;
+	size_t size = 0;
+	char *line = NULL;
+	uint64_t t0, t1;
+	int err = 0;
+
+	setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+
+	t0 = now_ns();
+
+	while (!err && getline(&line, &size, stdin) > 0) {
+		char *n, *m, *end;
+		uint64_t r;
+
+		n = strtok(line, " \t\r\n");
+		if (!n)
+			continue;
+		m = strtok(NULL, " \t\r\n");
+
+		if (m) {
+			uint64_t mod = strtoull(m, &end, 10);
+
+			if (*end || !mod || fib_mod_query(n, mod, &r)) {
+				fprintf(stderr, "Invalid query: %s %s\n", n, m);
+				err = -1;
+				break;
+			}
+			printf("%llu\n", (unsigned long long)r);
+		} else {
+			r = strtoull(n, &end, 10);
+			if (*end || *n == '-') {
+				fprintf(stderr, "Invalid query: %s\n", n);
+				err = -1;
+				break;
+			}
+			err = print_fib(r);
+		}
+
+		nr_queries++;
+	}
+
+	fflush(stdout);
+	t1 = now_ns();
+
+	fprintf(stderr, "%zu queries in %.3f s, %.0f queries/s\n", nr_queries,
+		(double)(t1 - t0) / NSEC_IN_SEC,
+		nr_queries * (double)NSEC_IN_SEC / (t1 - t0));
+
+	free(line);
+	return err;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-b] < n\n", prog);
+	printf("  -b  batch mode, a query per line: \"n\" or \"n m\" for F(n) mod m\n");
 }
 
 int main(int argc, char **argv)
 {
-	int n = 0;
+	long long n = 0;
+	int opt;
 
-	scanf("%d", &n);
+	while ((opt = getopt(argc, argv, "bh")) != -1) {
+		switch (opt) {
+		case 'b':
+			return batch() ? -1 : 0;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	scanf("%lld", &n);
 	if (n < MIN_NUM) {
 		fprintf(stderr, "Invalid number (must be >= %d)\n", MIN_NUM);
 		return -1;
 	}
-	if (n > 1000) {
-		fprintf(stderr, "Invalid number (must be < %d)\n", MAX_NUM);
-		return -1;
-	}
 
-	printf("%d\n", fib(n));
-	return 0;
+	return print_fib(n) ? -1 : 0;
 }
@@ -0,0 +1,112 @@
+/*
+ * fib_bench.c - fast doubling vs the iterative additions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "fibonacci.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static double ms(uint64_t t0, uint64_t t1)
+{
+	return (double)(t1 - t0) / 1e6;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n max n] [-i max n of the iterative]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t max_n = 10000000, max_iter = 100000;
+	uint64_t n;
+	int opt;
+	int err = 0;
+
+	while ((opt = getopt(argc, argv, "n:i:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_n = strtoull(optarg, NULL, 10);
+			break;
+		case 'i':
+			max_iter = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	printf("%10s  %10s  %12s  %12s  %12s\n", "n", "digits",
+	       "doubling ms", "iterative ms", "to string ms");
+
+	for (n = 1000; n <= max_n && !err; n *= 10) {
+		struct bignum fast = { 0 }, iter = { 0 };
+		uint64_t t0, t1, t2;
+		char *str = NULL;
+		double str_ms;
+
+		t0 = now_ns();
+		err = fib_fast(&fast, n);
+		t1 = now_ns();
+		if (!err)
+			str = bn_to_str(&fast);
+		t2 = now_ns();
+		str_ms = ms(t1, t2);
+
+		if (err || !str) {
+			fprintf(stderr, "Out of memory\n");
+			err = -1;
+			bn_free(&fast);
+			break;
+		}
+
+		printf("%10llu  %10zu  %12.2f", (unsigned long long)n,
+		       strlen(str), ms(t0, t1));
+
+		if (n <= max_iter) {
+			t0 = now_ns();
+			err = fib_iter(&iter, n);
+			t1 = now_ns();
+
+			if (!err && (iter.len != fast.len ||
+				     memcmp(iter.limb, fast.limb,
+					    fast.len * sizeof(*fast.limb)))) {
+				printf("\n");
+				fprintf(stderr, "F(%llu) mismatch\n",
+					(unsigned long long)n);
+				err = -1;
+			}
+
+			if (!err)
+				printf("  %12.2f", ms(t0, t1));
+		} else {
+			printf("  %12s", "-");
+		}
+
+		if (!err)
+			printf("  %12.2f\n", str_ms);
+		fflush(stdout);
+
+		free(str);
+		bn_free(&iter);
+		bn_free(&fast);
+	}
+
+	return err ? -1 : 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * fib_gen.c - generate the table of all the Fibonacci numbers which fit
+ * into 64 bits, the build includes it into fibonacci.c
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+int main(void)
+{
+	uint64_t a = 0, b = 1;
+	int n;
+
+	printf("/* generated by fib_gen, do not edit */\n\n");
+	printf("static const uint64_t fib_table[FIB_TABLE_SIZE] = {\n");
+
+	for (n = 0; n < 94; n++) {
+		uint64_t t = a + b;
+
+		printf("\t%lluULL,\n", (unsigned long long)a);
+
+		/* the last one would overflow */
+		a = b;
+		b = t;
+	}
+
+	printf("};\n");
+	return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * fibonacci.c - exact Fibonacci numbers of any size
+ */
+
+#include <ctype.h>
+
+#include "fibonacci.h"
+#include "fib_table.h"
+
+/*
+ * Fast doubling, O(log n) steps of big multiplications:
+ *
+ *   F(2k)     = F(k) (2 F(k + 1) - F(k))
+ *   F(2k + 1) = F(k + 1)^2 + F(k)^2
+ *
+ * going from the top bit of n, F(k + 1) is not needed after the last bit.
+ */
+int fib_fast(struct bignum *r, uint64_t n)
+{
+	struct bignum a = { 0 }, b = { 0 }, c = { 0 }, d = { 0 }, t = { 0 };
+	int bit = 63;
+	int err = -1;
+
+	if (bn_init(&a, 1) || bn_init(&b, 1) || bn_init(&c, 1) ||
+	    bn_init(&d, 1) || bn_init(&t, 1))
+		goto out;
+
+	/* F(0) and F(1) */
+	bn_set(&a, 0);
+	bn_set(&b, 1);
+
+	while (bit >= 0 && !(n >> bit))
+		bit--;
+
+	for (; bit >= 0; bit--) {
+		int odd = (n >> bit) & 1;
+
+		if (!bit && !odd) {
+			if (bn_add(&t, &b, &b) || bn_sub(&t, &t, &a) ||
+			    bn_mul(&c, &a, &t))
+				goto out;
+			bn_swap(&a, &c);
+			break;
+		}
+
+		if (!bit) {
+			if (bn_mul(&c, &a, &a) || bn_mul(&d, &b, &b) ||
+			    bn_add(&a, &c, &d))
+				goto out;
+			break;
+		}
+
+		/* c = F(2k), d = F(2k + 1) */
+		if (bn_add(&t, &b, &b) || bn_sub(&t, &t, &a) ||
+		    bn_mul(&c, &a, &t))
+			goto out;
+		if (bn_mul(&t, &a, &a) || bn_mul(&d, &b, &b) ||
+		    bn_add(&d, &d, &t))
+			goto out;
+
+		if (odd) {
+			if (bn_add(&c, &c, &d))
+				goto out;
+			bn_swap(&a, &d);
+			bn_swap(&b, &c);
+		} else {
+			bn_swap(&a, &c);
+			bn_swap(&b, &d);
+		}
+	}
+
+	bn_swap(r, &a);
+	err = 0;
+out:
+	bn_free(&a);
+	bn_free(&b);
+	bn_free(&c);
+	bn_free(&d);
+	bn_free(&t);
+	return err;
+}
+
+/* the plain O(n) additions */
+int fib_iter(struct bignum *r, uint64_t n)
+{
+	struct bignum a = { 0 }, b = { 0 };
+	uint64_t i;
+	int err = -1;
+
+	if (bn_init(&a, 1) || bn_init(&b, 1))
+		goto out;
+
+	bn_set(&a, 0);
+	bn_set(&b, 1);
+
+	for (i = 0; i < n; i++) {
+		/* a, b = b, a + b */
+		if (bn_add(&a, &a, &b))
+			goto out;
+		bn_swap(&a, &b);
+	}
+
+	bn_swap(r, &a);
+	err = 0;
+out:
+	bn_free(&a);
+	bn_free(&b);
+	return err;
+}
+
+/* n must be < FIB_TABLE_SIZE */
+uint64_t fib_u64(unsigned int n)
+{
+	return fib_table[n];
+}
+
+static inline uint64_t add_mod(uint64_t a, uint64_t b, uint64_t m)
+{
+	return a >= m - b ? a - (m - b) : a + b;
+}
+
+static inline uint64_t sub_mod(uint64_t a, uint64_t b, uint64_t m)
+{
+	return a >= b ? a - b : a + (m - b);
+}
+
+static inline uint64_t mul_mod(uint64_t a, uint64_t b, uint64_t m)
+{
+	return (unsigned __int128)a * b % m;
+}
+
+/* F(n) mod m with the fast doubling, m must be > 0 */
+uint64_t fib_mod(uint64_t n, uint64_t m)
+{
+	uint64_t a = 0, b = 1 % m;
+	int bit;
+
+	for (bit = 63; bit >= 0; bit--) {
+		uint64_t c, d;
+
+		c = mul_mod(a, sub_mod(add_mod(b, b, m), a, m), m);
+		d = add_mod(mul_mod(a, a, m), mul_mod(b, b, m), m);
+
+		if ((n >> bit) & 1) {
+			a = d;
+			b = add_mod(c, d, m);
+		} else {
+			a = c;
+			b = d;
+		}
+	}
+
+	return a;
+}
+
+/* 2x2 matrix [[a, b], [c, d]] */
+struct mat {
+	uint64_t a, b, c, d;
+};
+
+static struct mat mat_mul(struct mat x, struct mat y, uint64_t m)
+{
+	struct mat r;
+
+	r.a = add_mod(mul_mod(x.a, y.a, m), mul_mod(x.b, y.c, m), m);
+	r.b = add_mod(mul_mod(x.a, y.b, m), mul_mod(x.b, y.d, m), m);
+	r.c = add_mod(mul_mod(x.c, y.a, m), mul_mod(x.d, y.c, m), m);
+	r.d = add_mod(mul_mod(x.c, y.b, m), mul_mod(x.d, y.d, m), m);
+	return r;
+}
+
+/*
+ * F(n) mod m for n given as a decimal string of any length: Q^n with
+ * Q = [[1, 1], [1, 0]] is computed digit by digit as (Q^n')^10 Q^digit,
+ * and F(n) is its top right element. Returns -1 if n is not a number.
+ */
+int fib_mod_str(const char *n, uint64_t m, uint64_t *r)
+{
+	struct mat pow[10];
+	struct mat q;
+	int i;
+
+	if (!*n || !m)
+		return -1;
+
+	pow[0] = (struct mat) { 1 % m, 0, 0, 1 % m };
+	pow[1] = (struct mat) { 1 % m, 1 % m, 1 % m, 0 };
+	for (i = 2; i < 10; i++)
+		pow[i] = mat_mul(pow[i - 1], pow[1], m);
+
+	q = pow[0];
+	for (; *n; n++) {
+		struct mat q2, q4;
+
+		if (!isdigit((unsigned char)*n))
+			return -1;
+
+		q2 = mat_mul(q, q, m);
+		q4 = mat_mul(q2, q2, m);
+		q = mat_mul(q4, q, m);
+		q = mat_mul(q, q, m);
+		q = mat_mul(q, pow[*n - '0'], m);
+	}
+
+	*r = q.b;
+	return 0;
+}
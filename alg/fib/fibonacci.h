@@ -0,0 +1,18 @@
+#ifndef __FIBONACCI_H
+#define __FIBONACCI_H
+
+#include <stdint.h>
+
+#include "bignum.h"
+
+/* F(93) is the last one which fits into 64 bits */
+#define FIB_TABLE_SIZE	94
+
+int fib_fast(struct bignum *r, uint64_t n);
+int fib_iter(struct bignum *r, uint64_t n);
+
+uint64_t fib_u64(unsigned int n);
+uint64_t fib_mod(uint64_t n, uint64_t m);
+int fib_mod_str(const char *n, uint64_t m, uint64_t *r);
+
+#endif /* __FIBONACCI_H */
@@ -0,0 +1,476 @@
+/*
+ * extsort.c - external merge sort of the files of native 32-bit integers
+ *
+ * The input is read in runs of half the memory budget, each run is sorted
+ * with int_sort() (radix sort takes as much memory again for its buffer)
+ * and written to an unlinked temporary file. Then the runs are merged with
+ * a loser tree, the rest of the budget is split into the read buffers of
+ * the runs and the output buffer, so the I/O is done in large sequential
+ * chunks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "sort.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+#define MB		(1024 * 1024)
+
+#define DEFAULT_MEMORY_MB	256
+/* don't merge with read buffers smaller than this */
+#define MIN_BUF_SIZE		(64 * 1024)
+
+struct run {
+	int fd;
+	off_t off;
+	off_t end;
+	int *buf;
+	size_t len;
+	size_t pos;
+};
+
+/*
+ * node[0] is the index of the winner (the run with the smallest current
+ * key), node[1, k) keep the losers of the matches, run i is the leaf k + i.
+ * Exhausted runs have key INT64_MAX which is above any int.
+ */
+struct loser_tree {
+	size_t k;
+	size_t *node;
+	int64_t *key;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static int read_full(int fd, void *buf, size_t size, off_t off)
+{
+	char *p = buf;
+
+	while (size) {
+		ssize_t n = pread(fd, p, size, off);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		p += n;
+		off += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t size)
+{
+	const char *p = buf;
+
+	while (size) {
+		ssize_t n = write(fd, p, size);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			return -1;
+
+		p += n;
+		size -= n;
+	}
+
+	return 0;
+}
+
+static int loser_tree_init(struct loser_tree *lt, size_t k)
+{
+	lt->k = k;
+	lt->node = malloc(2 * k * sizeof(*lt->node));
+	lt->key = malloc(k * sizeof(*lt->key));
+
+	return lt->node && lt->key ? 0 : -1;
+}
+
+static void loser_tree_free(struct loser_tree *lt)
+{
+	free(lt->node);
+	free(lt->key);
+}
+
+/* play all the matches bottom up */
+static int loser_tree_build(struct loser_tree *lt)
+{
+	size_t i, k = lt->k;
+	size_t *win;
+
+	win = malloc(2 * k * sizeof(*win));
+	if (!win)
+		return -1;
+
+	for (i = 0; i < k; i++)
+		win[k + i] = i;
+
+	for (i = k - 1; i > 0; i--) {
+		size_t a = win[2 * i], b = win[2 * i + 1];
+
+		if (lt->key[b] < lt->key[a]) {
+			win[i] = b;
+			lt->node[i] = a;
+		} else {
+			win[i] = a;
+			lt->node[i] = b;
+		}
+	}
+
+	lt->node[0] = k > 1 ? win[1] : 0;
+	free(win);
+	return 0;
+}
+
+/* the key of the winner has changed, replay its path to the root */
+static inline void loser_tree_replay(struct loser_tree *lt)
+{
+	size_t w = lt->node[0];
+	size_t p;
+
+	for (p = (w + lt->k) / 2; p > 0; p /= 2) {
+		size_t l = lt->node[p];
+
+		if (lt->key[l] < lt->key[w]) {
+			lt->node[p] = w;
+			w = l;
+		}
+	}
+
+	lt->node[0] = w;
+}
+
+static int run_refill(struct run *run, size_t buf_len)
+{
+	size_t left = (run->end - run->off) / sizeof(int);
+
+	run->len = left < buf_len ? left : buf_len;
+	run->pos = 0;
+
+	if (!run->len)
+		return 0;
+
+	if (read_full(run->fd, run->buf, run->len * sizeof(int), run->off))
+		return -1;
+
+	run->off += run->len * sizeof(int);
+	return 0;
+}
+
+static int tmp_file(const char *tmpdir)
+{
+	char path[4096];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/extsort.XXXXXX", tmpdir);
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -1;
+
+	unlink(path);
+	return fd;
+}
+
+/*
+ * Sort the runs of run_len ints from the input into the temp files, or
+ * right into the output if the whole input fits into one run.
+ */
+static int make_runs(int in, off_t size, size_t run_len, int out,
+		     const char *tmpdir, struct run *runs, size_t *nr_runs)
+{
+	off_t off = 0;
+	size_t n = 0;
+	int *buf;
+
+	buf = malloc(run_len * sizeof(int));
+	if (!buf)
+		return -1;
+
+	while (off < size) {
+		size_t len = (size - off) / sizeof(int);
+		int fd;
+
+		if (len > run_len)
+			len = run_len;
+
+		if (read_full(in, buf, len * sizeof(int), off))
+			goto err;
+
+		int_sort(buf, len);
+
+		fd = off == 0 && len * sizeof(int) == (size_t)size ?
+		     out : tmp_file(tmpdir);
+		if (fd < 0)
+			goto err;
+
+		if (write_full(fd, buf, len * sizeof(int))) {
+			if (fd != out)
+				close(fd);
+			goto err;
+		}
+
+		runs[n].fd = fd;
+		runs[n].off = 0;
+		runs[n].end = len * sizeof(int);
+		n++;
+
+		off += len * sizeof(int);
+	}
+
+	free(buf);
+	*nr_runs = n;
+	return 0;
+
+err:
+	free(buf);
+	*nr_runs = n;
+	return -1;
+}
+
+static int merge_runs(struct run *runs, size_t k, size_t memory, int out)
+{
+	size_t buf_len = memory / (k + 1) / sizeof(int);
+	struct loser_tree lt = { 0 };
+	size_t out_len = 0;
+	int *out_buf;
+	int err = -1;
+	size_t i;
+
+	if (buf_len * sizeof(int) < MIN_BUF_SIZE) {
+		buf_len = MIN_BUF_SIZE / sizeof(int);
+		fprintf(stderr, "Warning: %zu runs exceed the memory budget\n",
+			k);
+	}
+
+	out_buf = malloc(buf_len * sizeof(int));
+	if (!out_buf || loser_tree_init(&lt, k))
+		goto out;
+
+	for (i = 0; i < k; i++) {
+		runs[i].buf = malloc(buf_len * sizeof(int));
+		if (!runs[i].buf || run_refill(&runs[i], buf_len))
+			goto out;
+		posix_fadvise(runs[i].fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+		lt.key[i] = runs[i].len ? runs[i].buf[0] : INT64_MAX;
+	}
+
+	if (loser_tree_build(&lt))
+		goto out;
+
+	for (;;) {
+		size_t w = lt.node[0];
+		struct run *run = &runs[w];
+
+		if (lt.key[w] == INT64_MAX)
+			break;
+
+		out_buf[out_len++] = lt.key[w];
+		if (out_len == buf_len) {
+			if (write_full(out, out_buf, out_len * sizeof(int)))
+				goto out;
+			out_len = 0;
+		}
+
+		if (++run->pos == run->len && run_refill(run, buf_len))
+			goto out;
+
+		lt.key[w] = run->len ? run->buf[run->pos] : INT64_MAX;
+		loser_tree_replay(&lt);
+	}
+
+	err = write_full(out, out_buf, out_len * sizeof(int));
+
+out:
+	for (i = 0; i < k; i++) {
+		free(runs[i].buf);
+		runs[i].buf = NULL;
+	}
+	loser_tree_free(&lt);
+	free(out_buf);
+	return err;
+}
+
+static int ext_sort(const char *input, const char *output, size_t memory,
+		    const char *tmpdir)
+{
+	uint64_t t0, t1, t2;
+	struct run *runs;
+	size_t nr_runs = 0;
+	size_t run_len;
+	struct stat st;
+	int in, out;
+	int err = -1;
+	size_t i;
+
+	in = open(input, O_RDONLY);
+	if (in < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", input,
+			strerror(errno));
+		return -1;
+	}
+
+	if (fstat(in, &st) || st.st_size % sizeof(int)) {
+		fprintf(stderr, "%s is not a file of %zu-byte integers\n",
+			input, sizeof(int));
+		close(in);
+		return -1;
+	}
+
+	out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (out < 0) {
+		fprintf(stderr, "Failed to open %s: %s\n", output,
+			strerror(errno));
+		close(in);
+		return -1;
+	}
+
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	run_len = memory / 2 / sizeof(int);
+	runs = calloc(st.st_size / sizeof(int) / run_len + 1, sizeof(*runs));
+	if (!runs)
+		goto out;
+
+	t0 = now_ns();
+	if (make_runs(in, st.st_size, run_len, out, tmpdir, runs, &nr_runs)) {
+		fprintf(stderr, "Failed to make the runs: %s\n",
+			strerror(errno));
+		goto out;
+	}
+	t1 = now_ns();
+
+	if (nr_runs > 1 && merge_runs(runs, nr_runs, memory, out)) {
+		fprintf(stderr, "Failed to merge the runs: %s\n",
+			strerror(errno));
+		goto out;
+	}
+	t2 = now_ns();
+
+	printf("%.1f MB, %zu runs of %zu MB\n", (double)st.st_size / MB,
+	       nr_runs, run_len * sizeof(int) / MB);
+	printf("runs:  %8.1f MB/s\n", (double)st.st_size / MB /
+	       ((double)(t1 - t0) / NSEC_IN_SEC));
+	if (nr_runs > 1)
+		printf("merge: %8.1f MB/s\n", (double)st.st_size / MB /
+		       ((double)(t2 - t1) / NSEC_IN_SEC));
+	printf("total: %8.1f MB/s\n", (double)st.st_size / MB /
+	       ((double)(t2 - t0) / NSEC_IN_SEC));
+
+	err = 0;
+out:
+	for (i = 0; i < nr_runs; i++) {
+		if (runs[i].fd != out)
+			close(runs[i].fd);
+	}
+	free(runs);
+	close(out);
+	close(in);
+	return err;
+}
+
+/* write count random integers to the file */
+static int generate(const char *output, size_t count)
+{
+	uint64_t rnd = 88172645463325252ULL ^ now_ns();
+	size_t buf_len = MB / sizeof(int);
+	int *buf;
+	int fd;
+
+	buf = malloc(buf_len * sizeof(int));
+	fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (!buf || fd < 0) {
+		fprintf(stderr, "Failed to create %s\n", output);
+		free(buf);
+		return -1;
+	}
+
+	while (count) {
+		size_t i, n = count < buf_len ? count : buf_len;
+
+		for (i = 0; i < n; i++) {
+			rnd ^= rnd << 13;
+			rnd ^= rnd >> 7;
+			rnd ^= rnd << 17;
+			buf[i] = rnd;
+		}
+
+		if (write_full(fd, buf, n * sizeof(int))) {
+			fprintf(stderr, "Failed to write %s\n", output);
+			break;
+		}
+		count -= n;
+	}
+
+	free(buf);
+	close(fd);
+	return count ? -1 : 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-m memory MB] [-T tmpdir] input output\n", prog);
+	printf("       %s -g count output\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	size_t memory = DEFAULT_MEMORY_MB;
+	const char *tmpdir = getenv("TMPDIR");
+	size_t count = 0;
+	int opt;
+
+	if (!tmpdir)
+		tmpdir = "/tmp";
+
+	while ((opt = getopt(argc, argv, "m:T:g:h")) != -1) {
+		switch (opt) {
+		case 'm':
+			memory = strtoul(optarg, NULL, 10);
+			break;
+		case 'T':
+			tmpdir = optarg;
+			break;
+		case 'g':
+			count = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (count) {
+		if (optind + 1 != argc) {
+			usage(argv[0]);
+			return -1;
+		}
+		return generate(argv[optind], count);
+	}
+
+	if (optind + 2 != argc || !memory) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	return ext_sort(argv[optind], argv[optind + 1], memory * MB, tmpdir);
+}
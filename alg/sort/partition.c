@@ -0,0 +1,230 @@
+/*
+ * partition.c - two-way partition kernels
+ *
+ * All the kernels split the array around the pivot value so that
+ *
+ *   array[0, m) < pivot, array[m, len) >= pivot
+ *
+ * and return m. partition_hoare() is the classic scan which branches on
+ * every comparison and so mispredicts on about every other element of the
+ * random input. partition_block() and partition_avx2() turn the comparisons
+ * into data (offsets or lane masks) and have no data dependent branches in
+ * the inner loops.
+ */
+
+#include <stdint.h>
+
+#include "sort.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+#ifndef SWAP
+#define SWAP(a, b) { typeof(a) __tmp = (a); (a) = (b); (b) = __tmp; }
+#endif
+
+/* BlockQuicksort block size, offsets must fit in uint8_t */
+#define BLOCK		64
+#define AVX2_LANES	8
+
+size_t partition_hoare(int *array, size_t len, int pivot)
+{
+	size_t i = 0, j = len;
+
+	for (;;) {
+		while (i < j && array[i] < pivot)
+			i++;
+		while (i < j && array[j - 1] >= pivot)
+			j--;
+
+		if (i >= j)
+			return i;
+
+		SWAP(array[i], array[j - 1]);
+		i++;
+		j--;
+	}
+}
+
+/*
+ * BlockQuicksort (Edelkamp, Weiss): scan a block from each end and only
+ * record the offsets of the misplaced elements, the comparison result just
+ * advances the offset counter. Then swap the misplaced pairs.
+ */
+size_t partition_block(int *array, size_t len, int pivot)
+{
+	uint8_t off_l[BLOCK], off_r[BLOCK];
+	size_t nr_l = 0, nr_r = 0;
+	size_t start_l = 0, start_r = 0;
+	size_t l = 0, r = len;
+	size_t i, n;
+
+	/* array[0, l) < pivot and array[r, len) >= pivot */
+	while (r - l >= 2 * BLOCK) {
+		if (!nr_l) {
+			start_l = 0;
+			for (i = 0; i < BLOCK; i++) {
+				off_l[nr_l] = i;
+				nr_l += array[l + i] >= pivot;
+			}
+		}
+
+		if (!nr_r) {
+			start_r = 0;
+			for (i = 0; i < BLOCK; i++) {
+				off_r[nr_r] = i;
+				nr_r += array[r - 1 - i] < pivot;
+			}
+		}
+
+		n = nr_l < nr_r ? nr_l : nr_r;
+		for (i = 0; i < n; i++)
+			SWAP(array[l + off_l[start_l + i]],
+			     array[r - 1 - off_r[start_r + i]]);
+
+		nr_l -= n;
+		nr_r -= n;
+		start_l += n;
+		start_r += n;
+
+		if (!nr_l)
+			l += BLOCK;
+		if (!nr_r)
+			r -= BLOCK;
+	}
+
+	/* less than two blocks left, one of them maybe partially swapped */
+	return l + partition_hoare(array + l, r - l, pivot);
+}
+
+#ifdef HAVE_AVX2_KERNEL
+
+/*
+ * For each mask of the lanes which are less than the pivot the permutation
+ * which moves them to the low lanes and the rest to the high lanes.
+ */
+static int32_t avx2_perm[1 << AVX2_LANES][AVX2_LANES];
+
+__attribute__((target("avx2")))
+static inline void avx2_store(__m256i v, __m256i p, int **wl, int **wr)
+{
+	int mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+					_mm256_cmpgt_epi32(p, v)));
+	__m256i perm = _mm256_loadu_si256((__m256i *)avx2_perm[mask]);
+	int nr_lt = __builtin_popcount(mask);
+
+	v = _mm256_permutevar8x32_epi32(v, perm);
+
+	_mm256_storeu_si256((__m256i *)*wl, v);
+	_mm256_storeu_si256((__m256i *)(*wr - AVX2_LANES), v);
+
+	*wl += nr_lt;
+	*wr -= AVX2_LANES - nr_lt;
+}
+
+/*
+ * In-place vectorized partition: a vector from each end is kept in the
+ * registers, which leaves enough room at both ends to store each next
+ * vector twice, permuted so that its lanes less than the pivot are stored
+ * to the left and the others to the right. The next vector is always read
+ * from the end with less room left.
+ */
+__attribute__((target("avx2")))
+size_t partition_avx2(int *array, size_t len, int pivot)
+{
+	__m256i p = _mm256_set1_epi32(pivot);
+	int *l = array, *r = array + len;
+	int *wl = array, *wr = array + len;
+	int tail[AVX2_LANES];
+	__m256i first, last;
+	size_t i, n;
+
+	if (len < 2 * AVX2_LANES)
+		return partition_hoare(array, len, pivot);
+
+	first = _mm256_loadu_si256((__m256i *)l);
+	last = _mm256_loadu_si256((__m256i *)(r - AVX2_LANES));
+	l += AVX2_LANES;
+	r -= AVX2_LANES;
+
+	while (r - l >= AVX2_LANES) {
+		__m256i v;
+
+		if (l - wl <= wr - r) {
+			v = _mm256_loadu_si256((__m256i *)l);
+			l += AVX2_LANES;
+		} else {
+			r -= AVX2_LANES;
+			v = _mm256_loadu_si256((__m256i *)r);
+		}
+
+		avx2_store(v, p, &wl, &wr);
+	}
+
+	n = r - l;
+	for (i = 0; i < n; i++)
+		tail[i] = l[i];
+	for (i = 0; i < n; i++) {
+		if (tail[i] < pivot)
+			*wl++ = tail[i];
+		else
+			*--wr = tail[i];
+	}
+
+	avx2_store(first, p, &wl, &wr);
+	avx2_store(last, p, &wl, &wr);
+
+	return wl - array;
+}
+
+int partition_avx2_supported(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+size_t partition_avx2(int *array, size_t len, int pivot)
+{
+	return partition_block(array, len, pivot);
+}
+
+int partition_avx2_supported(void)
+{
+	return 0;
+}
+
+#endif /* HAVE_AVX2_KERNEL */
+
+static size_t (*partition_kernel)(int *array, size_t len, int pivot) =
+	partition_block;
+
+__attribute__((constructor))
+static void partition_init(void)
+{
+#ifdef HAVE_AVX2_KERNEL
+	int mask, lane;
+
+	for (mask = 0; mask < 1 << AVX2_LANES; mask++) {
+		int lo = 0, hi = __builtin_popcount(mask);
+
+		for (lane = 0; lane < AVX2_LANES; lane++) {
+			if (mask & (1 << lane))
+				avx2_perm[mask][lo++] = lane;
+			else
+				avx2_perm[mask][hi++] = lane;
+		}
+	}
+#endif
+
+	if (partition_avx2_supported())
+		partition_kernel = partition_avx2;
+}
+
+/* the fastest kernel the CPU supports */
+size_t partition_fast(int *array, size_t len, int pivot)
+{
+	return partition_kernel(array, len, pivot);
+}
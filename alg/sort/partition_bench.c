@@ -0,0 +1,167 @@
+/*
+ * partition_bench.c - throughput of the partition kernels on random input
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sort.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+struct kernel {
+	const char *name;
+	size_t (*partition)(int *array, size_t len, int pivot);
+	int (*supported)(void);
+};
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static inline uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static size_t partition_three_way(int *array, size_t len, int pivot)
+{
+	size_t lt, gt;
+
+	partition(array, len, pivot, &lt, &gt);
+	return lt;
+}
+
+static const struct kernel kernels[] = {
+	{ "three-way", partition_three_way, NULL },
+	{ "hoare", partition_hoare, NULL },
+	{ "block", partition_block, NULL },
+	{ "avx2", partition_avx2, partition_avx2_supported },
+};
+
+#define NR_KERNELS	(sizeof(kernels) / sizeof(kernels[0]))
+
+static int check_partition(const int *array, size_t len, int pivot, size_t m,
+			   int64_t sum)
+{
+	int64_t s = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if ((i < m) != (array[i] < pivot))
+			return -1;
+		s += array[i];
+	}
+
+	return s == sum ? 0 : -1;
+}
+
+static int run_bench(const int *input, int *work, size_t len, int reps)
+{
+	int pivot = input[len / 2];
+	int64_t sum = 0;
+	size_t i, k;
+
+	for (i = 0; i < len; i++)
+		sum += input[i];
+
+	printf("n=%zu\n", len);
+
+	for (k = 0; k < NR_KERNELS; k++) {
+		uint64_t best = UINT64_MAX;
+		int r;
+
+		if (kernels[k].supported && !kernels[k].supported()) {
+			printf("  %-12s  not supported\n", kernels[k].name);
+			continue;
+		}
+
+		for (r = 0; r < reps; r++) {
+			uint64_t t0, t1;
+			size_t m;
+
+			memcpy(work, input, len * sizeof(int));
+
+			t0 = now_ns();
+			m = kernels[k].partition(work, len, pivot);
+			t1 = now_ns();
+
+			if (check_partition(work, len, pivot, m, sum)) {
+				fprintf(stderr, "%s: wrong partition\n",
+					kernels[k].name);
+				return -1;
+			}
+
+			if (t1 - t0 < best)
+				best = t1 - t0;
+		}
+
+		printf("  %-12s  %8.3f elements/ns\n", kernels[k].name,
+		       (double)len / best);
+	}
+	printf("\n");
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n max elements] [-r repeats] [-s seed]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_len = 10000000;
+	int *input, *work;
+	int reps = 10;
+	size_t len, i;
+	int opt;
+	int err = 0;
+
+	while ((opt = getopt(argc, argv, "n:r:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_len = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			reps = atoi(optarg);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 10) | 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	input = malloc(max_len * sizeof(int));
+	work = malloc(max_len * sizeof(int));
+	if (!input || !work) {
+		fprintf(stderr, "Failed to allocate %zu elements\n", max_len);
+		return -1;
+	}
+
+	for (i = 0; i < max_len; i++)
+		input[i] = rnd();
+
+	for (len = 1000; len <= max_len && !err; len *= 10)
+		err = run_bench(input, work, len, reps);
+
+	free(input);
+	free(work);
+	return err ? -1 : 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * psort.c - parallel introsort on a work-stealing pthread pool
+ *
+ * Every worker owns a deque of partitions to sort. A worker splits its
+ * partition, pushes the smaller part to the bottom of its deque and goes on
+ * with the larger one, so the deque holds the biggest pending partitions at
+ * the top where idle workers steal from. Partitions below PSORT_CUTOFF are
+ * sorted serially.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "sort.h"
+
+#define PSORT_CUTOFF	(1 << 15)
+#define DEQUE_SIZE	256
+#define STEAL_SPINS	64
+
+struct psort_task {
+	int *array;
+	size_t len;
+	int depth;
+};
+
+struct psort_deque {
+	pthread_spinlock_t lock;
+	/* tasks are in [top, bottom) */
+	size_t top;
+	size_t bottom;
+	struct psort_task tasks[DEQUE_SIZE];
+};
+
+struct psort_pool;
+
+struct psort_worker {
+	struct psort_pool *pool;
+	struct psort_deque deque;
+	pthread_t tid;
+	unsigned int id;
+	unsigned int seed;
+} __attribute__((aligned(64)));
+
+struct psort_pool {
+	struct psort_worker *workers;
+	unsigned int nr_workers;
+	/* tasks pushed but not finished yet */
+	atomic_size_t pending;
+};
+
+static bool deque_push(struct psort_deque *dq, struct psort_task *task)
+{
+	bool ok = false;
+
+	pthread_spin_lock(&dq->lock);
+
+	if (dq->bottom == DEQUE_SIZE && dq->top) {
+		size_t i;
+
+		for (i = dq->top; i < dq->bottom; i++)
+			dq->tasks[i - dq->top] = dq->tasks[i];
+		dq->bottom -= dq->top;
+		dq->top = 0;
+	}
+
+	if (dq->bottom < DEQUE_SIZE) {
+		dq->tasks[dq->bottom++] = *task;
+		ok = true;
+	}
+
+	pthread_spin_unlock(&dq->lock);
+	return ok;
+}
+
+/* the owner takes the most recent (smallest) partition */
+static bool deque_pop(struct psort_deque *dq, struct psort_task *task)
+{
+	bool ok = false;
+
+	pthread_spin_lock(&dq->lock);
+
+	if (dq->top < dq->bottom) {
+		*task = dq->tasks[--dq->bottom];
+		ok = true;
+	}
+
+	pthread_spin_unlock(&dq->lock);
+	return ok;
+}
+
+/* thieves take the oldest (biggest) partition */
+static bool deque_steal(struct psort_deque *dq, struct psort_task *task)
+{
+	bool ok = false;
+
+	if (pthread_spin_trylock(&dq->lock))
+		return false;
+
+	if (dq->top < dq->bottom) {
+		*task = dq->tasks[dq->top++];
+		ok = true;
+	}
+
+	pthread_spin_unlock(&dq->lock);
+	return ok;
+}
+
+static bool psort_steal(struct psort_worker *w, struct psort_task *task)
+{
+	struct psort_pool *pool = w->pool;
+	unsigned int i, victim;
+
+	w->seed = w->seed * 1103515245 + 12345;
+	victim = (w->seed >> 16) % pool->nr_workers;
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		struct psort_worker *v = &pool->workers[victim];
+
+		if (v != w && deque_steal(&v->deque, task))
+			return true;
+
+		if (++victim == pool->nr_workers)
+			victim = 0;
+	}
+
+	return false;
+}
+
+static void psort_run(struct psort_worker *w, struct psort_task *task)
+{
+	int *array = task->array;
+	size_t len = task->len;
+	int depth = task->depth;
+
+	while (len > PSORT_CUTOFF) {
+		struct psort_task sub;
+		size_t lt, gt;
+
+		if (depth-- == 0) {
+			heap_sort(array, len);
+			return;
+		}
+
+		partition(array, len, choose_pivot(array, len), &lt, &gt);
+
+		if (lt < len - gt) {
+			sub = (struct psort_task) { array, lt, depth };
+			array += gt;
+			len -= gt;
+		} else {
+			sub = (struct psort_task) { array + gt, len - gt, depth };
+			len = lt;
+		}
+
+		atomic_fetch_add(&w->pool->pending, 1);
+		if (!deque_push(&w->deque, &sub)) {
+			/* deque is full, sort it right away */
+			psort_run(w, &sub);
+			atomic_fetch_sub(&w->pool->pending, 1);
+		}
+	}
+
+	quick_sort(array, len);
+}
+
+static void psort_work(struct psort_worker *w)
+{
+	struct psort_pool *pool = w->pool;
+	unsigned int spins = 0;
+	struct psort_task task;
+
+	while (atomic_load(&pool->pending)) {
+		if (deque_pop(&w->deque, &task) || psort_steal(w, &task)) {
+			psort_run(w, &task);
+			atomic_fetch_sub(&pool->pending, 1);
+			spins = 0;
+		} else if (++spins > STEAL_SPINS) {
+			sched_yield();
+		}
+	}
+}
+
+static void *psort_worker_fn(void *arg)
+{
+	psort_work(arg);
+	return NULL;
+}
+
+/*
+ * Sort the array with nr_threads threads (including the caller), 0 means
+ * a thread per online CPU.
+ */
+int parallel_sort(int *array, size_t len, unsigned int nr_threads)
+{
+	struct psort_task task = { array, len, 0 };
+	struct psort_pool pool;
+	unsigned int i, started;
+	size_t n;
+	int err = 0;
+
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (nr_threads < 2 || len <= PSORT_CUTOFF) {
+		quick_sort(array, len);
+		return 0;
+	}
+
+	for (n = len; n > 1; n >>= 1)
+		task.depth += 2;
+
+	pool.workers = aligned_alloc(64, nr_threads * sizeof(*pool.workers));
+	if (!pool.workers)
+		return -1;
+
+	pool.nr_workers = nr_threads;
+	atomic_init(&pool.pending, 1);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct psort_worker *w = &pool.workers[i];
+
+		pthread_spin_init(&w->deque.lock, PTHREAD_PROCESS_PRIVATE);
+		w->deque.top = 0;
+		w->deque.bottom = 0;
+		w->pool = &pool;
+		w->id = i;
+		w->seed = i + 1;
+	}
+
+	deque_push(&pool.workers[0].deque, &task);
+
+	/* the caller is the worker #0 */
+	for (started = 1; started < nr_threads; started++) {
+		if (pthread_create(&pool.workers[started].tid, NULL,
+				   psort_worker_fn, &pool.workers[started])) {
+			err = -1;
+			break;
+		}
+	}
+
+	psort_work(&pool.workers[0]);
+
+	for (i = 1; i < started; i++)
+		pthread_join(pool.workers[i].tid, NULL);
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_spin_destroy(&pool.workers[i].deque.lock);
+
+	free(pool.workers);
+	return err;
+}
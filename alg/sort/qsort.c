@@ -1,68 +1,290 @@
-#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
-#ifndef ARRAY_SIZE
-#define ARRAY_SIZE(a) (sizeof(a)/sizeof(a[0]))
-#endif
+#include "sort.h"
 
 #ifndef SWAP
 #define SWAP(a, b) { typeof(a) __tmp = (a); (a) = (b); (b) = __tmp; }
 #endif
 
-static int partition(int *array, int from, int to)
+/* below this size insertion sort beats partitioning */
+#define INSERTION_CUTOFF	16
+/* use median of three medians (ninther) for the pivot above this size */
+#define NINTHER_CUTOFF		128
+/* below this size radix sort histogram and buffer overhead does not pay */
+#define RADIX_CUTOFF		4096
+
+#define RADIX_BITS		8
+#define RADIX_SIZE		(1 << RADIX_BITS)
+#define RADIX_PASSES		(32 / RADIX_BITS)
+
+static inline void swap_range(int *a, int *b, size_t n)
 {
-	int pivot = array[to];
-	int part_idx = from;
-	int i;
-
-	for (i = from; i < to; i++) {
-		if (array[i] <= pivot) {
-                    SWAP(array[part_idx], array[i]);
-		    part_idx++;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		SWAP(a[i], b[i]);
+}
+
+/*
+ * Three-way partition around the pivot value:
+ *
+ *   array[0, lt) < pivot, array[lt, gt) == pivot, array[gt, len) > pivot
+ *
+ * so runs of duplicates are excluded from the further partitioning. This is
+ * the Bentley-McIlroy scheme: Hoare-like scans from both ends which park the
+ * elements equal to the pivot at the ends and swap them to the middle at
+ * the end, so there are no extra swaps when keys are distinct.
+ */
+void partition(int *array, size_t len, int pivot, size_t *lt, size_t *gt)
+{
+	size_t i = 0, j = len;
+	size_t p = 0, q = len;
+	size_t n;
+
+	for (;;) {
+		while (i < j && array[i] <= pivot) {
+			if (array[i] == pivot) {
+				SWAP(array[p], array[i]);
+				p++;
+			}
+			i++;
 		}
+
+		while (i < j && array[j - 1] >= pivot) {
+			if (array[j - 1] == pivot) {
+				q--;
+				SWAP(array[q], array[j - 1]);
+			}
+			j--;
+		}
+
+		if (i >= j)
+			break;
+
+		SWAP(array[i], array[j - 1]);
+		i++;
+		j--;
 	}
-	SWAP(array[part_idx], array[to]);
 
-	return part_idx;
+	/* [0, p) ==, [p, i) <, [i, q) >, [q, len) == */
+	n = p < i - p ? p : i - p;
+	swap_range(array, array + i - n, n);
+
+	n = len - q < q - i ? len - q : q - i;
+	swap_range(array + i, array + len - n, n);
+
+	*lt = i - p;
+	*gt = i + (len - q);
+}
+
+void insertion_sort(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 1; i < len; i++) {
+		int val = array[i];
+		size_t j = i;
+
+		while (j > 0 && array[j - 1] > val) {
+			array[j] = array[j - 1];
+			j--;
+		}
+		array[j] = val;
+	}
 }
 
-static void quick_sort(int *array, int from, int to)
+static void sift_down(int *array, size_t root, size_t len)
 {
-	if (from < to) {
-		int idx = partition(array, from, to);
+	int val = array[root];
 
-		quick_sort(array, from, idx - 1);
-		quick_sort(array, idx + 1, to);
+	for (;;) {
+		size_t child = 2 * root + 1;
+
+		if (child >= len)
+			break;
+		if (child + 1 < len && array[child + 1] > array[child])
+			child++;
+		if (array[child] <= val)
+			break;
+
+		array[root] = array[child];
+		root = child;
 	}
+
+	array[root] = val;
 }
 
-static void print_array(int *array, size_t len)
+void heap_sort(int *array, size_t len)
 {
 	size_t i;
 
-	for (i = 0; i < len; i++)
-		printf("%d,", array[i]);
+	if (len < 2)
+		return;
+
+	for (i = len / 2; i > 0; i--)
+		sift_down(array, i - 1, len);
+
+	for (i = len - 1; i > 0; i--) {
+		SWAP(array[0], array[i]);
+		sift_down(array, 0, i);
+	}
 }
 
-static void test_sort(int *array, size_t len)
+static inline int median3(int a, int b, int c)
 {
-	printf("Before:");
-	print_array(array, len);
-	printf("\n");
+	if (a < b) {
+		if (b < c)
+			return b;
+		return a < c ? c : a;
+	}
+
+	if (a < c)
+		return a;
+	return b < c ? c : b;
+}
 
-	quick_sort(array, 0, len - 1);
+int choose_pivot(int *array, size_t len)
+{
+	size_t mid = len / 2;
+	size_t last = len - 1;
+
+	if (len > NINTHER_CUTOFF) {
+		size_t step = len / 8;
+
+		return median3(median3(array[0], array[step], array[2 * step]),
+			       median3(array[mid - step], array[mid],
+				       array[mid + step]),
+			       median3(array[last - 2 * step],
+				       array[last - step], array[last]));
+	}
 
-	printf("After:");
-	print_array(array, len);
-	printf("\n\n");
+	return median3(array[0], array[mid], array[last]);
 }
 
-int main(int argc, char **argv)
+static void intro_sort(int *array, size_t len, int depth)
 {
-	int array[] = { 1, 6, 3, 9, 11, 5, 4, 7, 2};
-	int array2[] = { 9, 1, 3, 8, 11, 5, 4, 7, 21};
+	while (len > INSERTION_CUTOFF) {
+		size_t lt, gt;
+		int pivot;
 
-	test_sort(array, ARRAY_SIZE(array));
-	test_sort(array2, ARRAY_SIZE(array));
+		/* too many bad pivots, fall back to the guaranteed O(n log n) */
+		if (depth-- == 0) {
+			heap_sort(array, len);
+			return;
+		}
+
+		pivot = choose_pivot(array, len);
+		lt = gt = partition_fast(array, len, pivot);
+
+		/*
+		 * Nothing is less than the pivot, so it is the minimum and
+		 * may well be repeated: take all its copies out of the way.
+		 */
+		if (!lt)
+			partition(array, len, pivot, &lt, &gt);
+
+		/* recurse into the smaller part and loop on the larger one */
+		if (lt < len - gt) {
+			intro_sort(array, lt, depth);
+			array += gt;
+			len -= gt;
+		} else {
+			intro_sort(array + gt, len - gt, depth);
+			len = lt;
+		}
+	}
+
+	insertion_sort(array, len);
+}
+
+void quick_sort(int *array, size_t len)
+{
+	int depth = 0;
+	size_t n;
+
+	for (n = len; n > 1; n >>= 1)
+		depth += 2;
 
-	return 0;
+	intro_sort(array, len, depth);
+}
+
+/*
+ * LSD radix sort of the 8-bit digits, the sign bit is flipped so negative
+ * numbers go first. The histograms of all the digits are counted in one
+ * pass, then each pass scatters the keys by one digit between the array
+ * and the buffer. A digit which is the same for all the keys (e.g. high
+ * bytes of the small numbers) is skipped.
+ */
+void radix_sort(int *array, size_t len)
+{
+	size_t count[RADIX_PASSES][RADIX_SIZE];
+	uint32_t *src = (uint32_t *)array;
+	uint32_t *buf, *dst;
+	int pass;
+	size_t i;
+
+	if (len < 2)
+		return;
+
+	buf = malloc(len * sizeof(*buf));
+	if (!buf) {
+		quick_sort(array, len);
+		return;
+	}
+
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < len; i++) {
+		uint32_t key = src[i] ^ 0x80000000;
+
+		for (pass = 0; pass < RADIX_PASSES; pass++)
+			count[pass][(key >> (pass * RADIX_BITS)) &
+				    (RADIX_SIZE - 1)]++;
+	}
+
+	dst = buf;
+	for (pass = 0; pass < RADIX_PASSES; pass++) {
+		int shift = pass * RADIX_BITS;
+		size_t *cnt = count[pass];
+		size_t sum = 0, n;
+		uint32_t *tmp;
+		int d;
+
+		if (cnt[((src[0] ^ 0x80000000) >> shift) &
+			(RADIX_SIZE - 1)] == len)
+			continue;
+
+		/* counts to the start offsets */
+		for (d = 0; d < RADIX_SIZE; d++) {
+			n = cnt[d];
+			cnt[d] = sum;
+			sum += n;
+		}
+
+		for (i = 0; i < len; i++) {
+			uint32_t key = src[i];
+
+			dst[cnt[((key ^ 0x80000000) >> shift) &
+				(RADIX_SIZE - 1)]++] = key;
+		}
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if (src != (uint32_t *)array)
+		memcpy(array, src, len * sizeof(*src));
+
+	free(buf);
+}
+
+/* radix sort for the big arrays, introsort for the small ones */
+void int_sort(int *array, size_t len)
+{
+	if (len < RADIX_CUTOFF)
+		quick_sort(array, len);
+	else
+		radix_sort(array, len);
 }
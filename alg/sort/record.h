@@ -0,0 +1,23 @@
+#ifndef __RECORD_H
+#define __RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* 16-byte key/value record used by record_bench */
+struct record {
+	uint64_t key;
+	uint64_t value;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void std_sort_records(struct record *array, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RECORD_H */
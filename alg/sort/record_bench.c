@@ -0,0 +1,215 @@
+/*
+ * record_bench.c - sorting of 16-byte key/value records by the key with the
+ * macro generated typed sort, libc qsort and std::sort
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "record.h"
+#include "typed_sort.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+#define FEW_UNIQUE	16
+
+SORT_DEFINE_BY_FIELD(record_sort, struct record, key)
+
+struct sorter {
+	const char *name;
+	void (*sort)(struct record *array, size_t len);
+};
+
+struct distribution {
+	const char *name;
+	uint64_t (*gen)(size_t i, size_t len);
+};
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static inline uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static uint64_t gen_sorted(size_t i, size_t len)
+{
+	(void)len;
+	return i;
+}
+
+static uint64_t gen_reversed(size_t i, size_t len)
+{
+	return len - i;
+}
+
+static uint64_t gen_random(size_t i, size_t len)
+{
+	(void)i;
+	(void)len;
+	return rnd();
+}
+
+static uint64_t gen_few_unique(size_t i, size_t len)
+{
+	(void)i;
+	(void)len;
+	return rnd() % FEW_UNIQUE;
+}
+
+static int cmp_record(const void *a, const void *b)
+{
+	uint64_t x = ((const struct record *)a)->key;
+	uint64_t y = ((const struct record *)b)->key;
+
+	return (x > y) - (x < y);
+}
+
+static void libc_qsort(struct record *array, size_t len)
+{
+	qsort(array, len, sizeof(*array), cmp_record);
+}
+
+static const struct distribution dists[] = {
+	{ "sorted", gen_sorted },
+	{ "reversed", gen_reversed },
+	{ "random", gen_random },
+	{ "few-unique", gen_few_unique },
+};
+
+static const struct sorter sorters[] = {
+	{ "record_sort", record_sort },
+	{ "libc qsort", libc_qsort },
+	{ "std::sort", std_sort_records },
+};
+
+#define NR_DISTS	(sizeof(dists) / sizeof(dists[0]))
+#define NR_SORTERS	(sizeof(sorters) / sizeof(sorters[0]))
+
+static uint64_t value_sum(const struct record *array, size_t len)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sum += array[i].value * (array[i].key | 1);
+
+	return sum;
+}
+
+static int check_sorted(const struct record *array, size_t len, uint64_t sum)
+{
+	size_t i;
+
+	for (i = 1; i < len; i++) {
+		if (array[i - 1].key > array[i].key)
+			return -1;
+	}
+
+	/* the values must still be attached to their keys */
+	return value_sum(array, len) == sum ? 0 : -1;
+}
+
+static int run_bench(struct record *input, struct record *work, size_t len)
+{
+	size_t d, s, i;
+
+	printf("n=%zu (ns/record)\n", len);
+	printf("  %-12s", "");
+	for (s = 0; s < NR_SORTERS; s++)
+		printf("  %12s", sorters[s].name);
+	printf("\n");
+
+	for (d = 0; d < NR_DISTS; d++) {
+		uint64_t sum;
+
+		for (i = 0; i < len; i++) {
+			input[i].key = dists[d].gen(i, len);
+			input[i].value = rnd();
+		}
+		sum = value_sum(input, len);
+
+		printf("  %-12s", dists[d].name);
+
+		for (s = 0; s < NR_SORTERS; s++) {
+			uint64_t t0, t1;
+
+			memcpy(work, input, len * sizeof(*input));
+
+			t0 = now_ns();
+			sorters[s].sort(work, len);
+			t1 = now_ns();
+
+			if (check_sorted(work, len, sum)) {
+				printf("\n");
+				fprintf(stderr, "%s: %s input is not sorted\n",
+					sorters[s].name, dists[d].name);
+				return -1;
+			}
+
+			printf("  %12.2f", (double)(t1 - t0) / len);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n max records] [-s seed]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_len = 10000000;
+	struct record *input, *work;
+	size_t len;
+	int opt;
+	int err = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_len = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 10) | 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	input = malloc(max_len * sizeof(*input));
+	work = malloc(max_len * sizeof(*work));
+	if (!input || !work) {
+		fprintf(stderr, "Failed to allocate %zu records\n", max_len);
+		return -1;
+	}
+
+	for (len = 1000; len <= max_len && !err; len *= 10)
+		err = run_bench(input, work, len);
+
+	free(input);
+	free(work);
+	return err ? -1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * select.c - selection of the k-th smallest and the k smallest elements
+ */
+
+#include <stdlib.h>
+
+#include "sort.h"
+
+#ifndef SWAP
+#define SWAP(a, b) { typeof(a) __tmp = (a); (a) = (b); (b) = __tmp; }
+#endif
+
+#define SELECT_CUTOFF	16
+#define GROUP		5
+
+static size_t linear_select(int *array, size_t len, size_t k);
+
+/*
+ * Median of the medians of the groups of five, it has at least 3/10 of
+ * the elements on each side so selection with it is linear in the worst
+ * case.
+ */
+static int median_of_medians(int *array, size_t len)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i + GROUP <= len; i += GROUP) {
+		insertion_sort(array + i, GROUP);
+		SWAP(array[n], array[i + GROUP / 2]);
+		n++;
+	}
+
+	if (!n)
+		return array[0];
+
+	return array[linear_select(array, n, n / 2)];
+}
+
+/*
+ * Narrow down to the part which holds the k-th element with the three-way
+ * partition around the given pivot, return the new bounds of the part
+ * or 1 if the k-th element is found (it is equal to the pivot).
+ */
+static int narrow(int **array, size_t *len, size_t *k, int pivot)
+{
+	size_t lt, gt;
+
+	partition(*array, *len, pivot, &lt, &gt);
+
+	if (*k < lt) {
+		*len = lt;
+	} else if (*k >= gt) {
+		*array += gt;
+		*len -= gt;
+		*k -= gt;
+	} else {
+		return 1;
+	}
+
+	return 0;
+}
+
+/* selection with the median of medians pivots only, returns the index */
+static size_t linear_select(int *array, size_t len, size_t k)
+{
+	int *base = array;
+
+	while (len > SELECT_CUTOFF) {
+		if (narrow(&array, &len, &k, median_of_medians(array, len)))
+			return array - base + k;
+	}
+
+	insertion_sort(array, len);
+	return array - base + k;
+}
+
+/*
+ * Introselect: quickselect with the sampled pivot, if it does not shrink
+ * the array fast enough switch to the median of medians pivots.
+ *
+ * Returns the k-th smallest element and leaves the array partitioned so
+ * that array[0, k) <= array[k] <= array[k + 1, len).
+ */
+int quick_select(int *array, size_t len, size_t k)
+{
+	int depth = 0;
+	size_t n;
+
+	for (n = len; n > 1; n >>= 1)
+		depth += 2;
+
+	while (len > SELECT_CUTOFF) {
+		int pivot;
+
+		if (depth-- == 0)
+			return array[linear_select(array, len, k)];
+
+		pivot = choose_pivot(array, len);
+		if (narrow(&array, &len, &k, pivot))
+			return pivot;
+	}
+
+	insertion_sort(array, len);
+	return array[k];
+}
+
+/* sort the k smallest elements to the front of the array */
+void partial_sort(int *array, size_t len, size_t k)
+{
+	if (k >= len) {
+		quick_sort(array, len);
+		return;
+	}
+
+	if (!k)
+		return;
+
+	quick_select(array, len, k - 1);
+	quick_sort(array, k - 1);
+}
+
+/*
+ * Streaming top-k: the k smallest values seen so far are kept in a max
+ * heap, so each next value is either dropped after one comparison with the
+ * root or replaces it.
+ */
+int topk_init(struct topk *t, size_t k)
+{
+	t->heap = malloc((k ? k : 1) * sizeof(int));
+	t->k = k;
+	t->len = 0;
+
+	return t->heap ? 0 : -1;
+}
+
+void topk_free(struct topk *t)
+{
+	free(t->heap);
+	t->heap = NULL;
+}
+
+static void topk_sift_down(int *heap, size_t len)
+{
+	size_t root = 0;
+	int val = heap[0];
+
+	for (;;) {
+		size_t child = 2 * root + 1;
+
+		if (child >= len)
+			break;
+		if (child + 1 < len && heap[child + 1] > heap[child])
+			child++;
+		if (heap[child] <= val)
+			break;
+
+		heap[root] = heap[child];
+		root = child;
+	}
+
+	heap[root] = val;
+}
+
+void topk_push(struct topk *t, int val)
+{
+	int *heap = t->heap;
+
+	if (t->len < t->k) {
+		size_t i = t->len++;
+
+		while (i > 0 && heap[(i - 1) / 2] < val) {
+			heap[i] = heap[(i - 1) / 2];
+			i = (i - 1) / 2;
+		}
+		heap[i] = val;
+	} else if (t->k && val < heap[0]) {
+		heap[0] = val;
+		topk_sift_down(heap, t->len);
+	}
+}
+
+/* sort the collected values ascending, returns their number */
+size_t topk_sort(struct topk *t)
+{
+	size_t i;
+
+	for (i = t->len; i > 1; i--) {
+		SWAP(t->heap[0], t->heap[i - 1]);
+		topk_sift_down(t->heap, i - 1);
+	}
+
+	return t->len;
+}
@@ -0,0 +1,165 @@
+/*
+ * select_bench.c - selection and top-k vs full sort of the random input
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sort.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+static uint64_t rnd_state = 88172645463325252ULL;
+
+static inline uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static double ms(uint64_t t0, uint64_t t1)
+{
+	return (double)(t1 - t0) / 1e6;
+}
+
+static int run_bench(const int *input, int *work, const int *sorted,
+		     size_t len, size_t k)
+{
+	uint64_t t0, t1;
+	struct topk t;
+	size_t i;
+	int val;
+
+	printf("  k=%-9zu", k);
+
+	/* quick_select of the k-th smallest */
+	memcpy(work, input, len * sizeof(int));
+	t0 = now_ns();
+	val = quick_select(work, len, k - 1);
+	t1 = now_ns();
+	if (val != sorted[k - 1])
+		goto err;
+	printf("  %12.2f", ms(t0, t1));
+
+	/* partial_sort of the k smallest */
+	memcpy(work, input, len * sizeof(int));
+	t0 = now_ns();
+	partial_sort(work, len, k);
+	t1 = now_ns();
+	if (memcmp(work, sorted, k * sizeof(int)))
+		goto err;
+	printf("  %12.2f", ms(t0, t1));
+
+	/* streaming top-k over the untouched input */
+	if (topk_init(&t, k))
+		return -1;
+	t0 = now_ns();
+	for (i = 0; i < len; i++)
+		topk_push(&t, input[i]);
+	topk_sort(&t);
+	t1 = now_ns();
+	if (memcmp(t.heap, sorted, k * sizeof(int))) {
+		topk_free(&t);
+		goto err;
+	}
+	topk_free(&t);
+	printf("  %12.2f\n", ms(t0, t1));
+
+	return 0;
+
+err:
+	printf("\n");
+	fprintf(stderr, "Wrong result for k=%zu\n", k);
+	return -1;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n elements] [-s seed]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const size_t ks[] = { 1, 100, 10000 };
+	int *input, *work, *sorted;
+	size_t len = 10000000;
+	double sort_ms;
+	uint64_t t0;
+	size_t i;
+	int opt;
+	int err = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			len = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 10) | 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (!len) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	input = malloc(len * sizeof(int));
+	work = malloc(len * sizeof(int));
+	sorted = malloc(len * sizeof(int));
+	if (!input || !work || !sorted) {
+		fprintf(stderr, "Failed to allocate %zu elements\n", len);
+		return -1;
+	}
+
+	for (i = 0; i < len; i++)
+		input[i] = rnd();
+
+	memcpy(sorted, input, len * sizeof(int));
+	t0 = now_ns();
+	quick_sort(sorted, len);
+	sort_ms = ms(t0, now_ns());
+
+	printf("n=%zu random (ms)\n", len);
+	printf("  %-11s  %12s  %12s  %12s\n", "", "quick_select",
+	       "partial_sort", "heap top-k");
+
+	for (i = 0; i < sizeof(ks) / sizeof(ks[0]) && !err; i++) {
+		if (ks[i] <= len)
+			err = run_bench(input, work, sorted, len, ks[i]);
+	}
+
+	if (!err) {
+		/* the median */
+		memcpy(work, input, len * sizeof(int));
+		t0 = now_ns();
+		if (quick_select(work, len, len / 2) != sorted[len / 2])
+			err = -1;
+		printf("  %-11s  %12.2f\n", "median", ms(t0, now_ns()));
+
+		printf("  %-11s  %12.2f\n", "quick_sort", sort_ms);
+	}
+
+	free(input);
+	free(work);
+	free(sorted);
+	return err ? -1 : 0;
+}
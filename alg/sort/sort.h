@@ -0,0 +1,36 @@
+#ifndef __SORT_H
+#define __SORT_H
+
+#include <stddef.h>
+
+int choose_pivot(int *array, size_t len);
+void partition(int *array, size_t len, int pivot, size_t *lt, size_t *gt);
+void quick_sort(int *array, size_t len);
+void heap_sort(int *array, size_t len);
+void insertion_sort(int *array, size_t len);
+void radix_sort(int *array, size_t len);
+void int_sort(int *array, size_t len);
+
+size_t partition_hoare(int *array, size_t len, int pivot);
+size_t partition_block(int *array, size_t len, int pivot);
+size_t partition_avx2(int *array, size_t len, int pivot);
+int partition_avx2_supported(void);
+size_t partition_fast(int *array, size_t len, int pivot);
+
+struct topk {
+	int *heap;
+	size_t k;
+	size_t len;
+};
+
+int quick_select(int *array, size_t len, size_t k);
+void partial_sort(int *array, size_t len, size_t k);
+
+int topk_init(struct topk *t, size_t k);
+void topk_free(struct topk *t);
+void topk_push(struct topk *t, int val);
+size_t topk_sort(struct topk *t);
+
+int parallel_sort(int *array, size_t len, unsigned int nr_threads);
+
+#endif /* __SORT_H */
@@ -0,0 +1,316 @@
+/*
+ * sort_bench.c - benchmark of the int sorts over various input distributions
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sort.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+#define FEW_UNIQUE	16
+
+struct sorter {
+	const char *name;
+	void (*sort)(int *array, size_t len);
+};
+
+struct distribution {
+	const char *name;
+	void (*gen)(int *array, size_t len);
+};
+
+static uint64_t rnd_state = 88172645463325252ULL;
+static unsigned int nr_threads;
+
+static inline uint64_t rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void gen_sorted(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		array[i] = i;
+}
+
+static void gen_reversed(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		array[i] = len - i;
+}
+
+static void gen_random(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		array[i] = rnd();
+}
+
+static void gen_few_unique(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		array[i] = rnd() % FEW_UNIQUE;
+}
+
+static void gen_organ_pipe(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		array[i] = i < len / 2 ? i : len - i;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	int x = *(const int *)a, y = *(const int *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void libc_qsort(int *array, size_t len)
+{
+	qsort(array, len, sizeof(int), cmp_int);
+}
+
+static void psort(int *array, size_t len)
+{
+	parallel_sort(array, len, nr_threads);
+}
+
+static const struct distribution dists[] = {
+	{ "sorted", gen_sorted },
+	{ "reversed", gen_reversed },
+	{ "random", gen_random },
+	{ "few-unique", gen_few_unique },
+	{ "organ-pipe", gen_organ_pipe },
+};
+
+static const struct sorter sorters[] = {
+	{ "quick_sort", quick_sort },
+	{ "radix_sort", radix_sort },
+	{ "int_sort", int_sort },
+	{ "libc qsort", libc_qsort },
+	{ "parallel", psort },
+};
+
+#define NR_DISTS	(sizeof(dists) / sizeof(dists[0]))
+#define NR_SORTERS	(sizeof(sorters) / sizeof(sorters[0]))
+
+static int64_t array_sum(const int *array, size_t len)
+{
+	int64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		sum += array[i];
+
+	return sum;
+}
+
+static int check_sorted(const int *array, size_t len, int64_t sum)
+{
+	size_t i;
+
+	for (i = 1; i < len; i++) {
+		if (array[i - 1] > array[i])
+			return -1;
+	}
+
+	return array_sum(array, len) == sum ? 0 : -1;
+}
+
+static int run_bench(int *input, int *work, size_t len)
+{
+	size_t d, s;
+
+	printf("n=%zu (ns/element)\n", len);
+	printf("  %-12s", "");
+	for (s = 0; s < NR_SORTERS; s++)
+		printf("  %12s", sorters[s].name);
+	printf("\n");
+
+	for (d = 0; d < NR_DISTS; d++) {
+		int64_t sum;
+
+		dists[d].gen(input, len);
+		sum = array_sum(input, len);
+
+		printf("  %-12s", dists[d].name);
+
+		for (s = 0; s < NR_SORTERS; s++) {
+			uint64_t t0, t1;
+
+			memcpy(work, input, len * sizeof(int));
+
+			t0 = now_ns();
+			sorters[s].sort(work, len);
+			t1 = now_ns();
+
+			if (check_sorted(work, len, sum)) {
+				printf("\n");
+				fprintf(stderr, "%s: %s input is not sorted\n",
+					sorters[s].name, dists[d].name);
+				return -1;
+			}
+
+			printf("  %12.2f", (double)(t1 - t0) / len);
+			fflush(stdout);
+		}
+		printf("\n");
+	}
+	printf("\n");
+
+	return 0;
+}
+
+static int time_sort(const struct sorter *sorter, const int *input, int *work,
+		     size_t len, int64_t sum, uint64_t *ns)
+{
+	uint64_t t0;
+
+	memcpy(work, input, len * sizeof(int));
+
+	t0 = now_ns();
+	sorter->sort(work, len);
+	*ns = now_ns() - t0;
+
+	if (check_sorted(work, len, sum)) {
+		fprintf(stderr, "%s: input is not sorted\n", sorter->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* parallel_sort of random input with 1..max_threads vs the serial sorts */
+static int run_scaling(int *input, int *work, size_t len,
+		       unsigned int max_threads)
+{
+	const struct sorter baseline = { "quick_sort", quick_sort };
+	uint64_t serial, ns;
+	unsigned int t;
+	int64_t sum;
+	size_t s;
+
+	gen_random(input, len);
+	sum = array_sum(input, len);
+
+	printf("scaling n=%zu random\n", len);
+	printf("  %-12s  %12s  %12s\n", "", "ms", "speedup");
+
+	/* speedup is relative to the serial quick_sort */
+	if (time_sort(&baseline, input, work, len, sum, &serial))
+		return -1;
+	printf("  %-12s  %12.2f  %12.2f\n", baseline.name, serial / 1e6, 1.0);
+
+	for (s = 0; s < NR_SORTERS; s++) {
+		if (sorters[s].sort == psort || sorters[s].sort == quick_sort)
+			continue;
+		if (time_sort(&sorters[s], input, work, len, sum, &ns))
+			return -1;
+		printf("  %-12s  %12.2f  %12.2f\n", sorters[s].name,
+		       ns / 1e6, (double)serial / ns);
+	}
+
+	for (t = 1; ; t *= 2) {
+		const struct sorter par = { "parallel", psort };
+		char name[32];
+
+		if (t > max_threads)
+			t = max_threads;
+
+		nr_threads = t;
+		if (time_sort(&par, input, work, len, sum, &ns))
+			return -1;
+
+		snprintf(name, sizeof(name), "%u threads", t);
+		printf("  %-12s  %12.2f  %12.2f\n", name,
+		       ns / 1e6, (double)serial / ns);
+		fflush(stdout);
+
+		if (t == max_threads)
+			break;
+	}
+	printf("\n");
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n max elements] [-s seed] [-t threads]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_len = 10000000;
+	int *input, *work;
+	size_t len;
+	unsigned int max_threads;
+	int opt;
+	int err = 0;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((opt = getopt(argc, argv, "n:s:t:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			max_len = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 10) | 1;
+			break;
+		case 't':
+			max_threads = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	input = malloc(max_len * sizeof(int));
+	work = malloc(max_len * sizeof(int));
+	if (!input || !work) {
+		fprintf(stderr, "Failed to allocate %zu elements\n", max_len);
+		return -1;
+	}
+
+	if (!max_threads)
+		max_threads = 1;
+	nr_threads = max_threads;
+
+	for (len = 1000; len <= max_len && !err; len *= 10)
+		err = run_bench(input, work, len);
+
+	if (!err)
+		err = run_scaling(input, work, max_len, max_threads);
+
+	free(input);
+	free(work);
+	return err ? -1 : 0;
+}
@@ -0,0 +1,39 @@
+#include <stdio.h>
+
+#include "sort.h"
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof(a[0]))
+#endif
+
+static void print_array(int *array, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		printf("%d,", array[i]);
+}
+
+static void test_sort(int *array, size_t len)
+{
+	printf("Before:");
+	print_array(array, len);
+	printf("\n");
+
+	quick_sort(array, len);
+
+	printf("After:");
+	print_array(array, len);
+	printf("\n\n");
+}
+
+int main(int argc, char **argv)
+{
+	int array[] = { 1, 6, 3, 9, 11, 5, 4, 7, 2};
+	int array2[] = { 9, 1, 3, 8, 11, 5, 4, 7, 21};
+
+	test_sort(array, ARRAY_SIZE(array));
+	test_sort(array2, ARRAY_SIZE(array2));
+
+	return 0;
+}
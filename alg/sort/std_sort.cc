@@ -0,0 +1,15 @@
+/*
+ * std_sort.cc - std::sort of the records for comparison in record_bench
+ */
+
+#include <algorithm>
+
+#include "record.h"
+
+void std_sort_records(struct record *array, size_t len)
+{
+	std::sort(array, array + len,
+		  [](const struct record &a, const struct record &b) {
+			return a.key < b.key;
+		  });
+}
@@ -0,0 +1,77 @@
+/*
+ * topk.c - print the k smallest integers read from stdin
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "sort.h"
+
+/* scanf() is way slower than the top-k itself */
+static int read_int(int *val)
+{
+	int c, neg = 0;
+	long v = 0;
+
+	do {
+		c = getchar_unlocked();
+	} while (c != EOF && isspace(c));
+
+	if (c == EOF)
+		return -1;
+
+	if (c == '-') {
+		neg = 1;
+		c = getchar_unlocked();
+	}
+
+	if (!isdigit(c))
+		return -1;
+
+	for (; isdigit(c); c = getchar_unlocked())
+		v = v * 10 + (c - '0');
+
+	*val = neg ? -v : v;
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-k count] < numbers\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct topk t;
+	size_t k = 10;
+	size_t i, n;
+	int opt, val;
+
+	while ((opt = getopt(argc, argv, "k:h")) != -1) {
+		switch (opt) {
+		case 'k':
+			k = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (topk_init(&t, k)) {
+		fprintf(stderr, "Failed to allocate %zu elements\n", k);
+		return -1;
+	}
+
+	while (!read_int(&val))
+		topk_push(&t, val);
+
+	n = topk_sort(&t);
+	for (i = 0; i < n; i++)
+		printf("%d\n", t.heap[i]);
+
+	topk_free(&t);
+	return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef __TYPED_SORT_H
+#define __TYPED_SORT_H
+
+/*
+ * typed_sort.h - introsort specialised for the element type at compile time
+ *
+ * SORT_DEFINE(name, type, less) defines
+ *
+ *   static void name(type *array, size_t len);
+ *
+ * where less(const type *a, const type *b) is a macro or an inline function
+ * returning non-zero if a goes before b. Unlike qsort(3) the comparison is
+ * inlined into the sort and the elements are moved by assignment instead of
+ * memcpy of the run-time size.
+ *
+ * SORT_DEFINE_BY_FIELD(name, type, field) sorts the structs in the ascending
+ * order of the given scalar field:
+ *
+ *   struct record { uint64_t key; uint64_t value; };
+ *   SORT_DEFINE_BY_FIELD(record_sort, struct record, key)
+ */
+
+#include <stddef.h>
+
+#define SORT_INSERTION_CUTOFF	16
+
+#define SORT_DEFINE(name, type, less)					\
+static inline void name##_swap(type *a, type *b)			\
+{									\
+	type tmp = *a;							\
+	*a = *b;							\
+	*b = tmp;							\
+}									\
+									\
+static void name##_insertion(type *array, size_t len)			\
+{									\
+	size_t i;							\
+									\
+	for (i = 1; i < len; i++) {					\
+		type val = array[i];					\
+		size_t j = i;						\
+									\
+		while (j > 0 && less(&val, &array[j - 1])) {		\
+			array[j] = array[j - 1];			\
+			j--;						\
+		}							\
+		array[j] = val;						\
+	}								\
+}									\
+									\
+static void name##_sift_down(type *array, size_t root, size_t len)	\
+{									\
+	type val = array[root];						\
+									\
+	for (;;) {							\
+		size_t child = 2 * root + 1;				\
+									\
+		if (child >= len)					\
+			break;						\
+		if (child + 1 < len &&					\
+		    less(&array[child], &array[child + 1]))		\
+			child++;					\
+		if (!less(&val, &array[child]))				\
+			break;						\
+									\
+		array[root] = array[child];				\
+		root = child;						\
+	}								\
+									\
+	array[root] = val;						\
+}									\
+									\
+static void name##_heap(type *array, size_t len)			\
+{									\
+	size_t i;							\
+									\
+	for (i = len / 2; i > 0; i--)					\
+		name##_sift_down(array, i - 1, len);			\
+									\
+	for (i = len - 1; i > 0; i--) {					\
+		name##_swap(&array[0], &array[i]);			\
+		name##_sift_down(array, 0, i);				\
+	}								\
+}									\
+									\
+/*									\
+ * Order the first, middle and last elements, use the middle one as the	\
+ * pivot parked at [1] and the outer ones as the sentinels of the scans.	\
+ */									\
+static size_t name##_partition(type *array, size_t len)			\
+{									\
+	size_t i = 1, j = len - 1;					\
+	type pivot;							\
+									\
+	name##_swap(&array[1], &array[len / 2]);			\
+	if (less(&array[1], &array[0]))					\
+		name##_swap(&array[0], &array[1]);			\
+	if (less(&array[len - 1], &array[1]))				\
+		name##_swap(&array[1], &array[len - 1]);		\
+	if (less(&array[1], &array[0]))					\
+		name##_swap(&array[0], &array[1]);			\
+									\
+	pivot = array[1];						\
+									\
+	for (;;) {							\
+		do							\
+			i++;						\
+		while (less(&array[i], &pivot));			\
+		do							\
+			j--;						\
+		while (less(&pivot, &array[j]));			\
+									\
+		if (i >= j)						\
+			break;						\
+									\
+		name##_swap(&array[i], &array[j]);			\
+	}								\
+									\
+	name##_swap(&array[1], &array[j]);				\
+	return j;							\
+}									\
+									\
+static void name##_intro(type *array, size_t len, int depth)		\
+{									\
+	while (len > SORT_INSERTION_CUTOFF) {				\
+		size_t p;						\
+									\
+		if (depth-- == 0) {					\
+			name##_heap(array, len);			\
+			return;						\
+		}							\
+									\
+		p = name##_partition(array, len);			\
+									\
+		if (p < len - p) {					\
+			name##_intro(array, p, depth);			\
+			array += p + 1;					\
+			len -= p + 1;					\
+		} else {						\
+			name##_intro(array + p + 1, len - p - 1, depth);	\
+			len = p;					\
+		}							\
+	}								\
+									\
+	name##_insertion(array, len);					\
+}									\
+									\
+static inline void name(type *array, size_t len)			\
+{									\
+	int depth = 0;							\
+	size_t n;							\
+									\
+	for (n = len; n > 1; n >>= 1)					\
+		depth += 2;						\
+									\
+	name##_intro(array, len, depth);				\
+}
+
+#define SORT_FIELD_LESS(a, b, field)	((a)->field < (b)->field)
+
+#define SORT_DEFINE_BY_FIELD(name, type, field)				\
+static inline int name##_less(const type *a, const type *b)		\
+{									\
+	return SORT_FIELD_LESS(a, b, field);				\
+}									\
+SORT_DEFINE(name, type, name##_less)
+
+#endif /* __TYPED_SORT_H */
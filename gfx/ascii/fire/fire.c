@@ -1,14 +1,28 @@
 /*
  * fire.c - draw fire animation
+ *
+ * Classic heat propagation: two hidden fuel rows under the screen get
+ * random heat every frame, every visible cell takes the average of the
+ * three cells below it and the one two rows below, minus a random cooling.
+ * The heat is kept in two uint8_t buffers (this and the previous frame) and
+ * mapped to a character and a colour through a palette. Only the rows whose
+ * palette levels changed are handed to curses, as one call per row.
  */
 
 #include <signal.h>
 #include <curses.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 
 #define USEC_IN_MSEC 1000
+#define FRAME_MSEC   40
+
+/* hidden rows under the screen which feed the fire */
+#define FUEL_ROWS    2
+/* the flame should reach that part of the screen height, in 1/4 */
+#define FLAME_HEIGHT 3
 
 static volatile bool do_break = false;
 
@@ -21,42 +35,162 @@ static void sig_handler(int sig)
 #define MIDDLE_COLOR 2
 #define UPPER_COLOR  1
 
+struct palette_entry {
+	char ch;
+	int color;
+	int attr;
+};
+
+/* from cold to hot, heat is scaled to an index in here */
+static const struct palette_entry palette[] = {
+	{ ' ', UPPER_COLOR,  A_NORMAL },
+	{ '.', UPPER_COLOR,  A_NORMAL },
+	{ ':', UPPER_COLOR,  A_NORMAL },
+	{ '*', UPPER_COLOR,  A_BOLD },
+	{ 's', MIDDLE_COLOR, A_NORMAL },
+	{ 'S', MIDDLE_COLOR, A_BOLD },
+	{ '#', LOWER_COLOR,  A_NORMAL },
+	{ '$', LOWER_COLOR,  A_BOLD },
+};
+
+#define PALETTE_SIZE (sizeof(palette) / sizeof(palette[0]))
+
+static chtype level_ch[PALETTE_SIZE];
+static uint8_t heat_level[256];
+
 static int max_x, max_y;
+/* columns with a cold cell on each side, so the rows need no edge checks */
+static int width;
+static uint8_t *heat[2];
+static uint8_t *shown;
+static chtype *line;
+static int cool_max;
+static uint32_t seed = 2463534242U;
 
 static void delay(void)
 {
-	usleep(USEC_IN_MSEC * 150);
+	usleep(USEC_IN_MSEC * FRAME_MSEC);
 }
 
-static void draw_flame(void)
+/* xorshift, random() per cell costs more than the whole update */
+static inline uint32_t rnd(void)
 {
-	int x;
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
 
-	for (x = 0; x < max_x; x++) {
-		int y0 = random() % (max_y / 2);
-		int color;
-		int y;
+static void init_palette(void)
+{
+	unsigned int i;
 
-		for (y = 0; y <= max_y; y++) {
-			if (y < y0) {
-				mvaddch(y, x, ' ');
-				continue;
-			}
+	for (i = 0; i < PALETTE_SIZE; i++)
+		level_ch[i] = palette[i].ch | COLOR_PAIR(palette[i].color) |
+			      palette[i].attr;
 
-			for (color = UPPER_COLOR; color <= LOWER_COLOR; color++) {
-				if (y <= y0 + ((max_y - y0) / 3) * color)
-					break;
-			}
+	for (i = 0; i < 256; i++)
+		heat_level[i] = i * PALETTE_SIZE / 256;
+}
+
+static int init_fire(void)
+{
+	size_t cells;
+	int rows;
+
+	if (max_x < 1 || max_y < 1)
+		return -1;
+
+	width = max_x + 2;
+	rows = max_y + FUEL_ROWS;
+	cells = (size_t)width * rows;
+
+	heat[0] = calloc(cells, 1);
+	heat[1] = calloc(cells, 1);
+	/* nothing is drawn yet, 0xff never matches a level */
+	shown = malloc((size_t)max_x * max_y);
+	line = malloc(sizeof(*line) * max_x);
+	if (!heat[0] || !heat[1] || !shown || !line)
+		return -1;
+	memset(shown, 0xff, (size_t)max_x * max_y);
+
+	/*
+	 * The averaging keeps the heat on average, so the cooling decides the
+	 * height: cool_max / 2 per row on average burns 255 out in about
+	 * FLAME_HEIGHT / 4 of the screen.
+	 */
+	cool_max = 2 * 255 * 4 / (FLAME_HEIGHT * max_y) + 1;
+
+	return 0;
+}
+
+static void free_fire(void)
+{
+	free(heat[0]);
+	free(heat[1]);
+	free(shown);
+	free(line);
+}
+
+static void update_fire(const uint8_t *cur, uint8_t *next)
+{
+	int x, y;
+
+	for (y = max_y; y < max_y + FUEL_ROWS; y++) {
+		uint8_t *row = next + (size_t)y * width;
+
+		for (x = 1; x <= max_x; x++)
+			row[x] = (rnd() & 3) ? 255 : rnd() & 0x7f;
+	}
+
+	for (y = 0; y < max_y; y++) {
+		const uint8_t *below = cur + (size_t)(y + 1) * width;
+		const uint8_t *below2 = below + width;
+		uint8_t *row = next + (size_t)y * width;
+
+		for (x = 1; x <= max_x; x++) {
+			int h = below[x - 1] + below[x] + below[x + 1] +
+				below2[x];
 
-			attron(COLOR_PAIR(color) | A_BOLD);
-			mvaddch(y, x, '0');
-			attroff(COLOR_PAIR(color) | A_BOLD);
+			h = h / 4 - (int)(rnd() % cool_max);
+			row[x] = h > 0 ? h : 0;
 		}
 	}
 }
 
+static void draw_fire(const uint8_t *cur)
+{
+	int x, y;
+
+	for (y = 0; y < max_y; y++) {
+		const uint8_t *row = cur + (size_t)y * width + 1;
+		uint8_t *levels = shown + (size_t)y * max_x;
+		bool changed = false;
+
+		for (x = 0; x < max_x; x++) {
+			uint8_t level = heat_level[row[x]];
+
+			if (level != levels[x]) {
+				levels[x] = level;
+				changed = true;
+			}
+		}
+
+		if (!changed)
+			continue;
+
+		for (x = 0; x < max_x; x++)
+			line[x] = level_ch[levels[x]];
+		mvaddchnstr(y, 0, line, max_x);
+	}
+}
+
 int main(int argc, char **argv)
 {
+	int cur = 0;
+
+	signal(SIGINT, sig_handler);
+
 	initscr();
 	noecho();
 	curs_set(false);
@@ -69,12 +203,23 @@ int main(int argc, char **argv)
 
 	getmaxyx(stdscr, max_y, max_x);
 
+	init_palette();
+	if (init_fire()) {
+		endwin();
+		free_fire();
+		return -1;
+	}
+
 	while (!do_break) {
-		draw_flame();
+		update_fire(heat[cur], heat[!cur]);
+		cur = !cur;
+
+		draw_fire(heat[cur]);
 		refresh();
 		delay();
 	}
 
 	endwin();
+	free_fire();
 	return 0;
 }
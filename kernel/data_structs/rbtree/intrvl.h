@@ -0,0 +1,414 @@
+/*
+ * intrvl.h - set of disjoint u32 intervals on top of rbtree
+ *
+ * Shared by the kernel module and the userspace build, the includer has to
+ * provide rbtree (with rb_set_parent_color from rbtree_augmented.h),
+ * kmalloc/kfree, kvmalloc_array/kvfree, prefetch, min/max and pr_info.
+ */
+
+#ifndef __INTRVL_H
+#define __INTRVL_H
+
+struct interval_node {
+	struct rb_node node;
+	u32 min;
+	u32 max;
+};
+
+struct interval {
+	u32 min;
+	u32 max;
+};
+
+/* read-only copy of the tree in Eytzinger (BFS) order, iv[0] is unused */
+struct frozen_intervals {
+	struct interval *iv;
+	size_t len;
+};
+
+static inline struct interval_node *interval_alloc(u32 min, u32 max)
+{
+	struct interval_node *n;
+
+	n = kmalloc(sizeof(*n), GFP_KERNEL);
+	if (!n)
+		return NULL;
+
+	RB_CLEAR_NODE(&n->node);
+	n->min = min;
+	n->max = max;
+	return n;
+}
+
+static inline void interval_free(struct rb_root *root, struct interval_node *n)
+{
+	rb_erase(&n->node, root);
+	kfree(n);
+}
+
+/* does x end at or after val (or right before it if merging adjacent) ? */
+static inline bool interval_reaches(struct interval_node *x, u32 val, bool adj)
+{
+	return x->max >= val || (adj && x->max + 1 == val);
+}
+
+/* does x start at or before val (or right after it if merging adjacent) ? */
+static inline bool interval_starts_by(struct interval_node *x, u32 val, bool adj)
+{
+	return x->min <= val || (adj && val != U32_MAX && x->min == val + 1);
+}
+
+/*
+ * Intervals in the tree are disjoint, so both min and max grow in the
+ * in-order walk and the first interval which may overlap [val,...] can be
+ * found by a single descent.
+ */
+static inline struct interval_node *
+interval_first_from(struct rb_root *root, u32 val, bool adj)
+{
+	struct rb_node *node = root->rb_node;
+	struct interval_node *first = NULL;
+
+	while (node) {
+		struct interval_node *x = rb_entry(node, struct interval_node,
+						   node);
+
+		if (interval_reaches(x, val, adj)) {
+			first = x;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	return first;
+}
+
+/* link a node which is known to not overlap with any other one */
+static inline void interval_link(struct rb_root *root, struct interval_node *n)
+{
+	struct rb_node **new = &root->rb_node, *parent = NULL;
+
+	while (*new) {
+		struct interval_node *x = rb_entry(*new, struct interval_node,
+						   node);
+
+		parent = *new;
+
+		if (n->min > x->max)
+			new = &((*new)->rb_right);
+		else
+			new = &((*new)->rb_left);
+	}
+
+	rb_link_node(&n->node, parent, new);
+	rb_insert_color(&n->node, root);
+}
+
+/*
+ * Add [from,to] to the set, all the overlapping (and adjacent if adj is
+ * set) intervals are coalesced into the first one and
+ * the rest of them are freed. Takes O(log n + k) where k is the number of
+ * merged intervals.
+ */
+static inline int insert_interval(struct rb_root *root, u32 from, u32 to, bool adj)
+{
+	struct interval_node *x, *keep = NULL;
+	struct interval_node *n;
+
+	x = interval_first_from(root, from, adj);
+
+	while (x && interval_starts_by(x, to, adj)) {
+		struct rb_node *next = rb_next(&x->node);
+
+		if (!keep) {
+			/* new interval already exists in the another one */
+			if (x->min <= from && x->max >= to) {
+				pr_info("skip:[%u,%u]\n", from, to);
+				return 0;
+			}
+
+			keep = x;
+		} else {
+			pr_info("merge:[%u,%u] + [%u,%u]\n",
+				keep->min, keep->max, x->min, x->max);
+
+			to = max(to, x->max);
+			interval_free(root, x);
+		}
+
+		x = next ? rb_entry(next, struct interval_node, node) : NULL;
+	}
+
+	/* update interval if needed */
+	if (keep) {
+		u32 new_min = min(from, keep->min);
+		u32 new_max = max(to, keep->max);
+
+		pr_info("update:[%u,%u] -> [%u,%u]\n",
+			keep->min, keep->max, new_min, new_max);
+
+		keep->min = new_min;
+		keep->max = new_max;
+		return 0;
+	}
+
+	n = interval_alloc(from, to);
+	if (!n)
+		return -ENOMEM;
+
+	interval_link(root, n);
+	pr_info("add:[%u,%u]\n", n->min, n->max);
+	return 0;
+}
+
+static inline struct interval_node *search_interval(struct rb_root *root, u32 val)
+{
+	struct rb_node *node = root->rb_node;
+
+	while (node) {
+		struct interval_node *n = container_of(node, struct
+				interval_node, node);
+
+		if (val < n->min)
+			node = node->rb_left;
+		else if (val > n->max)
+			node = node->rb_right;
+		else
+			return n;
+	}
+
+	return NULL;
+}
+
+static inline int remove_interval(struct rb_root *root, u32 val)
+{
+	struct interval_node *interv;
+
+	interv = search_interval(root, val);
+	if (!interv)
+		return -1;
+
+	pr_info("removed:[%u,%u]\n", interv->min, interv->max);
+	interval_free(root, interv);
+	return 0;
+}
+
+/*
+ * Remove [from,to] from the set, intervals which partially overlap with it
+ * are trimmed and the one which fully covers it is split into two.
+ */
+static inline int remove_range(struct rb_root *root, u32 from, u32 to)
+{
+	struct interval_node *x;
+
+	x = interval_first_from(root, from, false);
+
+	while (x && x->min <= to) {
+		struct rb_node *next = rb_next(&x->node);
+
+		if (x->min < from && x->max > to) {
+			struct interval_node *n;
+
+			n = interval_alloc(to + 1, x->max);
+			if (!n)
+				return -ENOMEM;
+
+			pr_info("split:[%u,%u] -> [%u,%u] [%u,%u]\n",
+				x->min, x->max, x->min, from - 1, n->min, n->max);
+
+			x->max = from - 1;
+			interval_link(root, n);
+			return 0;
+		} else if (x->min < from) {
+			pr_info("trim:[%u,%u] -> [%u,%u]\n",
+				x->min, x->max, x->min, from - 1);
+			x->max = from - 1;
+		} else if (x->max > to) {
+			pr_info("trim:[%u,%u] -> [%u,%u]\n",
+				x->min, x->max, to + 1, x->max);
+			x->min = to + 1;
+		} else {
+			pr_info("removed:[%u,%u]\n", x->min, x->max);
+			interval_free(root, x);
+		}
+
+		x = next ? rb_entry(next, struct interval_node, node) : NULL;
+	}
+
+	return 0;
+}
+
+static inline void destroy_tree(struct rb_root *root)
+{
+	struct interval_node *n, *tmp;
+
+	rbtree_postorder_for_each_entry_safe(n, tmp, root, node)
+		kfree(n);
+
+	*root = RB_ROOT;
+}
+
+struct interval_build {
+	const struct interval *iv;
+	size_t i;
+	size_t n;
+	struct interval_node *free;
+	int red_depth;
+};
+
+/* take the next interval from the sorted input coalescing overlapping ones */
+static inline void interval_build_next(struct interval_build *b, u32 *min, u32 *max)
+{
+	*min = b->iv[b->i].min;
+	*max = b->iv[b->i].max;
+
+	for (b->i++; b->i < b->n && b->iv[b->i].min <= *max; b->i++)
+		*max = max(*max, b->iv[b->i].max);
+}
+
+static inline struct rb_node *
+interval_build_subtree(struct interval_build *b, size_t count, int depth,
+		       struct rb_node *parent)
+{
+	struct interval_node *n;
+	size_t left;
+
+	if (!count)
+		return NULL;
+
+	left = (count - 1) / 2;
+	n = b->free;
+	b->free = rb_entry_safe(n->node.rb_right, struct interval_node, node);
+
+	n->node.rb_left = interval_build_subtree(b, left, depth + 1, &n->node);
+	interval_build_next(b, &n->min, &n->max);
+	n->node.rb_right = interval_build_subtree(b, count - left - 1,
+						  depth + 1, &n->node);
+
+	/* only the last (not completely filled) level is red */
+	rb_set_parent_color(&n->node, parent,
+			    depth == b->red_depth ? RB_RED : RB_BLACK);
+	return &n->node;
+}
+
+/*
+ * Build the tree from intervals sorted by min in O(n), overlapping
+ * intervals are coalesced. The subtree sizes differ at most by one so only
+ * the deepest level is not complete, all the nodes above it are black.
+ */
+static inline int build_tree(struct rb_root *root,
+			     const struct interval *iv, size_t n)
+{
+	struct interval_build b = { .iv = iv, .n = n };
+	size_t count = 0;
+	size_t i;
+	u32 min, max;
+
+	if (!RB_EMPTY_ROOT(root))
+		return -EEXIST;
+	if (!n)
+		return 0;
+
+	while (b.i < b.n) {
+		interval_build_next(&b, &min, &max);
+		count++;
+	}
+
+	/* preallocate all the nodes chained via rb_right */
+	for (i = 0; i < count; i++) {
+		struct interval_node *x = interval_alloc(0, 0);
+
+		if (!x) {
+			while (b.free) {
+				x = b.free;
+				b.free = rb_entry_safe(x->node.rb_right,
+						       struct interval_node,
+						       node);
+				kfree(x);
+			}
+			return -ENOMEM;
+		}
+
+		x->node.rb_right = b.free ? &b.free->node : NULL;
+		b.free = x;
+	}
+
+	b.i = 0;
+	b.red_depth = ilog2(count);
+	if (!b.red_depth)
+		b.red_depth = -1;
+
+	root->rb_node = interval_build_subtree(&b, count, 0, NULL);
+	pr_info("built:%zu intervals from %zu\n", count, n);
+	return 0;
+}
+
+static inline void frozen_fill(struct frozen_intervals *f, size_t k,
+			       struct rb_node **node)
+{
+	struct interval_node *x;
+
+	if (k > f->len)
+		return;
+
+	frozen_fill(f, 2 * k, node);
+
+	x = rb_entry(*node, struct interval_node, node);
+	f->iv[k].min = x->min;
+	f->iv[k].max = x->max;
+	*node = rb_next(*node);
+
+	frozen_fill(f, 2 * k + 1, node);
+}
+
+/* make a read-only copy of the tree for the pointer-free lookups */
+static inline int freeze_tree(struct rb_root *root, struct frozen_intervals *f)
+{
+	struct rb_node *node;
+	size_t count = 0;
+
+	for (node = rb_first(root); node; node = rb_next(node))
+		count++;
+
+	f->iv = kvmalloc_array(count + 1, sizeof(*f->iv), GFP_KERNEL);
+	if (!f->iv)
+		return -ENOMEM;
+
+	f->len = count;
+	node = rb_first(root);
+	frozen_fill(f, 1, &node);
+	return 0;
+}
+
+/*
+ * Both min and max are sorted, so find the first interval which ends at or
+ * after val going down the implicit tree, k then encodes the path and the
+ * answer is the node where we turned left the last time.
+ */
+static inline struct interval *
+search_frozen(const struct frozen_intervals *f, u32 val)
+{
+	unsigned long k = 1;
+
+	while (k <= f->len) {
+		/* 8 intervals per cache line, fetch 3 levels ahead */
+		prefetch(f->iv + 8 * k);
+		k = 2 * k + (f->iv[k].max < val);
+	}
+	k >>= __builtin_ffsl(~k);
+
+	if (!k || f->iv[k].min > val)
+		return NULL;
+
+	return &f->iv[k];
+}
+
+static inline void frozen_free(struct frozen_intervals *f)
+{
+	kvfree(f->iv);
+	f->iv = NULL;
+	f->len = 0;
+}
+
+#endif /* __INTRVL_H */
@@ -0,0 +1,391 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/rbtree_latch.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/cpumask.h>
+
+/*
+ * Interval set which can be looked up concurrently from many CPUs. Readers
+ * walk a latched rbtree (two copies updated in turn under a seqcount) under
+ * RCU without taking any lock, writers are serialised by a mutex and free
+ * removed intervals after a grace period.
+ */
+
+#define INTERVAL_STRIDE	16
+#define INTERVAL_LEN	8
+#define LOOKUP_BATCH	1024
+
+static unsigned int nr_intervals = 100000;
+module_param(nr_intervals, uint, 0444);
+MODULE_PARM_DESC(nr_intervals, "Number of intervals in the set");
+
+static unsigned int duration_ms = 1000;
+module_param(duration_ms, uint, 0444);
+MODULE_PARM_DESC(duration_ms, "Duration of each benchmark round");
+
+static bool writer = true;
+module_param(writer, bool, 0444);
+MODULE_PARM_DESC(writer, "Run a writer which removes and inserts intervals");
+
+struct rcu_interval {
+	struct latch_tree_node lt;
+	struct rcu_head rcu;
+	u32 min;
+	u32 max;
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	u32 seed;
+	u64 ops;
+	u64 hits;
+	u64 ns;
+} ____cacheline_aligned;
+
+static struct latch_tree_root intervals;
+static DEFINE_MUTEX(writer_lock);
+
+static struct bench_thread *readers;
+static struct bench_thread writer_thread;
+
+static inline struct rcu_interval *lt_to_interval(struct latch_tree_node *lt)
+{
+	return container_of(lt, struct rcu_interval, lt);
+}
+
+static bool rcu_interval_less(struct latch_tree_node *a,
+			      struct latch_tree_node *b)
+{
+	return lt_to_interval(a)->min < lt_to_interval(b)->min;
+}
+
+static int rcu_interval_comp(void *key, struct latch_tree_node *lt)
+{
+	struct rcu_interval *x = lt_to_interval(lt);
+	u32 val = *(u32 *)key;
+
+	if (val < x->min)
+		return -1;
+	if (val > x->max)
+		return 1;
+	return 0;
+}
+
+static const struct latch_tree_ops rcu_interval_ops = {
+	.less = rcu_interval_less,
+	.comp = rcu_interval_comp,
+};
+
+static bool rcu_search_interval(u32 val, u32 *min, u32 *max)
+{
+	struct latch_tree_node *lt;
+	bool found = false;
+
+	rcu_read_lock();
+	lt = latch_tree_find(&val, &intervals, &rcu_interval_ops);
+	if (lt) {
+		struct rcu_interval *x = lt_to_interval(lt);
+
+		*min = x->min;
+		*max = x->max;
+		found = true;
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
+/* the writer owns both trees, so it can walk the first one directly */
+static struct rcu_interval *rcu_interval_first_from(u32 val)
+{
+	struct rb_node *node = intervals.tree[0].rb_node;
+	struct rcu_interval *first = NULL;
+
+	lockdep_assert_held(&writer_lock);
+
+	while (node) {
+		struct rcu_interval *x = container_of(node, struct rcu_interval,
+						      lt.node[0]);
+
+		if (x->max >= val) {
+			first = x;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+
+	return first;
+}
+
+static struct rcu_interval *rcu_interval_next(struct rcu_interval *x)
+{
+	struct rb_node *next = rb_next(&x->lt.node[0]);
+
+	return next ? container_of(next, struct rcu_interval, lt.node[0]) : NULL;
+}
+
+/*
+ * Coalescing can't widen a node in place as readers may be walking it, so
+ * the merged interval is inserted as a new node first and the absorbed ones
+ * are erased after it, this way a value which was in the set is always
+ * found by the readers.
+ */
+static int rcu_insert_interval(u32 from, u32 to)
+{
+	struct rcu_interval *n, *x, *first;
+
+	n = kmalloc(sizeof(*n), GFP_KERNEL);
+	if (!n)
+		return -ENOMEM;
+
+	mutex_lock(&writer_lock);
+
+	first = rcu_interval_first_from(from);
+
+	for (x = first; x && x->min <= to; x = rcu_interval_next(x)) {
+		from = min(from, x->min);
+		to = max(to, x->max);
+	}
+
+	n->min = from;
+	n->max = to;
+	latch_tree_insert(&n->lt, &intervals, &rcu_interval_ops);
+
+	x = first;
+	while (x && x->min <= to) {
+		struct rcu_interval *next = rcu_interval_next(x);
+
+		if (x != n) {
+			latch_tree_erase(&x->lt, &intervals, &rcu_interval_ops);
+			kfree_rcu(x, rcu);
+		}
+
+		x = next;
+	}
+
+	mutex_unlock(&writer_lock);
+	return 0;
+}
+
+static int rcu_remove_interval(u32 val)
+{
+	struct latch_tree_node *lt;
+
+	mutex_lock(&writer_lock);
+
+	lt = latch_tree_find(&val, &intervals, &rcu_interval_ops);
+	if (!lt) {
+		mutex_unlock(&writer_lock);
+		return -1;
+	}
+
+	latch_tree_erase(lt, &intervals, &rcu_interval_ops);
+	mutex_unlock(&writer_lock);
+
+	kfree_rcu(lt_to_interval(lt), rcu);
+	return 0;
+}
+
+static void rcu_destroy_intervals(void)
+{
+	struct rcu_interval *n, *tmp;
+
+	/* wait for kfree_rcu() of the removed intervals */
+	rcu_barrier();
+
+	rbtree_postorder_for_each_entry_safe(n, tmp, &intervals.tree[0],
+					     lt.node[0])
+		kfree(n);
+
+	intervals.tree[0] = RB_ROOT;
+	intervals.tree[1] = RB_ROOT;
+}
+
+static inline u32 bench_rand(struct bench_thread *t)
+{
+	t->seed ^= t->seed << 13;
+	t->seed ^= t->seed >> 17;
+	t->seed ^= t->seed << 5;
+	return t->seed;
+}
+
+static int reader_fn(void *arg)
+{
+	struct bench_thread *t = arg;
+	u32 range = nr_intervals * INTERVAL_STRIDE;
+	u64 start = ktime_get_ns();
+
+	while (!kthread_should_stop()) {
+		u32 min, max;
+		int i;
+
+		for (i = 0; i < LOOKUP_BATCH; i++)
+			t->hits += rcu_search_interval(bench_rand(t) % range,
+						       &min, &max);
+
+		t->ops += LOOKUP_BATCH;
+		cond_resched();
+	}
+
+	t->ns = ktime_get_ns() - start;
+	return 0;
+}
+
+static int writer_fn(void *arg)
+{
+	struct bench_thread *t = arg;
+	u64 start = ktime_get_ns();
+
+	while (!kthread_should_stop()) {
+		u32 min = (bench_rand(t) % nr_intervals) * INTERVAL_STRIDE;
+
+		rcu_remove_interval(min);
+		if (!rcu_insert_interval(min, min + INTERVAL_LEN - 1))
+			t->ops += 2;
+		cond_resched();
+	}
+
+	t->ns = ktime_get_ns() - start;
+	return 0;
+}
+
+static struct task_struct *bench_thread_run(int (*fn)(void *),
+					    struct bench_thread *t,
+					    unsigned int cpu)
+{
+	struct task_struct *task;
+
+	memset(t, 0, sizeof(*t));
+	t->seed = 2463534242U + cpu;
+
+	task = kthread_create_on_node(fn, t, cpu_to_node(cpu), "intrvl/%u", cpu);
+	if (IS_ERR(task))
+		return task;
+
+	kthread_bind(task, cpu);
+	t->task = task;
+	wake_up_process(task);
+	return task;
+}
+
+static int bench_round(unsigned int nr_readers)
+{
+	unsigned int cpu = cpumask_first(cpu_online_mask);
+	u64 lookups = 0, hits = 0, rate = 0;
+	unsigned int started = 0;
+	int err = 0;
+	int i;
+
+	/* the writer sits on the first CPU, readers on the next ones */
+	if (writer) {
+		struct task_struct *task;
+
+		task = bench_thread_run(writer_fn, &writer_thread, cpu);
+		if (IS_ERR(task))
+			return PTR_ERR(task);
+	}
+
+	for (i = 0; i < nr_readers; i++) {
+		struct task_struct *task;
+
+		if (num_online_cpus() > 1) {
+			cpu = cpumask_next(cpu, cpu_online_mask);
+			if (cpu >= nr_cpu_ids)
+				cpu = cpumask_next(cpumask_first(cpu_online_mask),
+						   cpu_online_mask);
+		}
+
+		task = bench_thread_run(reader_fn, &readers[i], cpu);
+		if (IS_ERR(task)) {
+			err = PTR_ERR(task);
+			break;
+		}
+		started++;
+	}
+
+	msleep(duration_ms);
+
+	for (i = 0; i < started; i++) {
+		kthread_stop(readers[i].task);
+
+		lookups += readers[i].ops;
+		hits += readers[i].hits;
+		rate += div64_u64(readers[i].ops * NSEC_PER_MSEC,
+				  max_t(u64, readers[i].ns, 1));
+	}
+
+	if (writer)
+		kthread_stop(writer_thread.task);
+
+	if (err)
+		return err;
+
+	pr_info("readers=%u lookups/ms=%llu (%llu per reader) hit=%llu%% writer updates/ms=%llu\n",
+		nr_readers, rate, div_u64(rate, nr_readers),
+		div64_u64(hits * 100, max_t(u64, lookups, 1)),
+		writer ? div64_u64(writer_thread.ops * NSEC_PER_MSEC,
+				   max_t(u64, writer_thread.ns, 1)) : 0);
+	return 0;
+}
+
+static int intrvl_rcu_init(void)
+{
+	unsigned int max_readers = max(num_online_cpus() - 1, 1U);
+	unsigned int nr;
+	int err;
+	u32 i;
+
+	pr_info("RCU Interval Tree: init\n");
+	pr_info("=======================\n");
+
+	seqcount_init(&intervals.seq);
+
+	for (i = 0; i < nr_intervals; i++) {
+		err = rcu_insert_interval(i * INTERVAL_STRIDE,
+					  i * INTERVAL_STRIDE + INTERVAL_LEN - 1);
+		if (err)
+			goto out;
+	}
+
+	readers = kcalloc(max_readers, sizeof(*readers), GFP_KERNEL);
+	if (!readers) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	for (nr = 1; ; nr = min(nr * 2, max_readers)) {
+		err = bench_round(nr);
+		if (err || nr == max_readers)
+			break;
+	}
+
+	kfree(readers);
+out:
+	if (err)
+		rcu_destroy_intervals();
+	return err;
+}
+
+static void intrvl_rcu_exit(void)
+{
+	rcu_destroy_intervals();
+
+	pr_info("RCU Interval Tree: exit\n");
+	pr_info("=======================\n\n");
+}
+
+module_init(intrvl_rcu_init);
+module_exit(intrvl_rcu_exit);
+
+MODULE_AUTHOR("Vadim Kochan <vadim4j@gmail.com>");
+MODULE_DESCRIPTION("RCU protected Interval Tree Module");
+MODULE_LICENSE("GPL");
@@ -4,16 +4,23 @@
 #include <linux/kernel.h>
 
 #include <linux/rbtree.h>
+#include <linux/rbtree_augmented.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+#include <linux/prefetch.h>
 
-static struct rb_root tree = RB_ROOT;
+#include "intrvl.h"
 
-struct interval_node {
-	struct rb_node node;
-	u32 min;
-	u32 max;
-};
+/* merge intervals which only touch each other, e.g. [1,3] + [4,6] -> [1,6] */
+static bool merge_adjacent;
+module_param(merge_adjacent, bool, 0444);
+MODULE_PARM_DESC(merge_adjacent, "Coalesce adjacent (not only overlapping) intervals");
 
-static struct interval_node intervals[] = {
+static struct rb_root tree = RB_ROOT;
+static struct rb_root bulk_tree = RB_ROOT;
+
+static struct interval intervals[] = {
 	{ .min = 3, .max = 6 },
 	{ .min = 7, .max = 9 },
 	{ .min = 10, .max = 15 },
@@ -21,78 +28,20 @@ static struct interval_node intervals[] = {
 	{ .min = 4, .max = 5 },
 	/* should update [3,6] -> [1,6] */
 	{ .min = 1, .max = 4 },
+	/* should merge [7,9] and [10,15] into [7,20] */
+	{ .min = 8, .max = 20 },
 };
 
-static void insert_interval(struct rb_root *root, struct interval_node *n)
-{
-	struct rb_node **new = &root->rb_node, *parent = NULL;
-
-	while (*new) {
-		struct interval_node *x = container_of(*new, struct
-				interval_node, node);
-
-		parent = *new;
-
-		if (n->min > x->max) {
-			new = &((*new)->rb_right);
-		} else if (n->max < x->min) {
-			new = &((*new)->rb_left);
-		} else {
-			u32 new_min = min(n->min, x->min);
-			u32 new_max = max(n->max, x->max);
-
-			/* update interval if needed */
-			if (x->min != new_min || x->max != new_max) {
-				pr_info("update:[%u,%u] -> [%u,%u]\n",
-					x->min, x->max, new_min, new_max);
-
-				x->min = new_min;
-				x->max = new_max;
-				return;
-			}
-
-			/* new interval already exists in the another one */
-			pr_info("skip:[%u,%u]\n", n->min, n->max);
-			return;
-		}
-	}
-
-	rb_link_node(&n->node, parent, new);
-	rb_insert_color(&n->node, root);
-	pr_info("add:[%u,%u]\n", n->min, n->max);
-}
-
-static struct interval_node *search_interval(struct rb_root *root, u32 val)
-{
-	struct rb_node *node = root->rb_node;
-
-	while (node) {
-		struct interval_node *n = container_of(node, struct
-				interval_node, node);
-
-		if (val < n->min)
-			node = node->rb_left;
-		else if (val > n->max)
-			node = node->rb_right;
-		else
-			return n;
-	}
-
-	return NULL;
-}
-
-static int remove_interval(struct rb_root *root, u32 val)
-{
-	struct interval_node *interv;
-
-	interv = search_interval(root, val);
-	if (!interv)
-		return -1;
-
-	rb_erase(&interv->node, root);
-	pr_info("removed:[%u,%u]\n", interv->min, interv->max);
-	return 0;
-}
+/* sorted by min, bulk loaded in one pass */
+static struct interval sorted_intervals[] = {
+	{ .min = 1, .max = 2 },
+	{ .min = 5, .max = 8 },
+	/* should be coalesced with [5,8] */
+	{ .min = 6, .max = 11 },
+	{ .min = 20, .max = 30 },
+	{ .min = 40, .max = 41 },
+	{ .min = 50, .max = 60 },
+};
 
 static void print_tree(struct rb_root *root)
 {
@@ -111,14 +60,20 @@ static void print_tree(struct rb_root *root)
 
 static int interval_tree_init(void)
 {
+	struct frozen_intervals frozen;
 	struct interval_node *find;
+	struct interval *found;
 	int i;
 
 	pr_info("Interval Tree: init\n");
 	pr_info("===================\n");
 
 	for (i = 0; i < ARRAY_SIZE(intervals); i++) {
-		insert_interval(&tree, &intervals[i]);
+		if (insert_interval(&tree, intervals[i].min, intervals[i].max,
+				    merge_adjacent)) {
+			pr_err("failed to insert interval\n");
+			goto err;
+		}
 	}
 
 	print_tree(&tree);
@@ -133,9 +88,15 @@ static int interval_tree_init(void)
 		pr_info("found:[%u,%u]\n", find->min, find->max);
 	}
 
+	/* should split [7,20] -> [7,11] [14,20] */
+	if (remove_range(&tree, 12, 13)) {
+		pr_err("failed to remove range [%u,%u]\n", 12, 13);
+		goto err;
+	}
+
 	if (remove_interval(&tree, 10)) {
 		pr_err("failed to remove interval with value=%u\n", 10);
-		return -1;
+		goto err;
 	}
 	find = search_interval(&tree, 10);
 	if (find) {
@@ -144,11 +105,43 @@ static int interval_tree_init(void)
 
 	print_tree(&tree);
 
+	if (build_tree(&bulk_tree, sorted_intervals,
+		       ARRAY_SIZE(sorted_intervals))) {
+		pr_err("failed to build tree\n");
+		goto err;
+	}
+
+	print_tree(&bulk_tree);
+
+	if (freeze_tree(&bulk_tree, &frozen)) {
+		pr_err("failed to freeze tree\n");
+		goto err;
+	}
+
+	found = search_frozen(&frozen, 9);
+	if (found) {
+		pr_info("found frozen:[%u,%u]\n", found->min, found->max);
+	}
+
+	found = search_frozen(&frozen, 35);
+	if (found) {
+		pr_err("found frozen in a gap:[%u,%u]\n", found->min, found->max);
+	}
+
+	frozen_free(&frozen);
 	return 0;
+
+err:
+	destroy_tree(&bulk_tree);
+	destroy_tree(&tree);
+	return -1;
 }
 
 static void interval_tree_exit(void)
 {
+	destroy_tree(&bulk_tree);
+	destroy_tree(&tree);
+
 	pr_info("Interval Tree: exit\n");
 	pr_info("===================\n\n");
 }
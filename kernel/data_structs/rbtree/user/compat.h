@@ -0,0 +1,40 @@
+/*
+ * compat.h - kernel API used by intrvl.h mapped to libc
+ */
+
+#ifndef __COMPAT_H
+#define __COMPAT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define U32_MAX		UINT32_MAX
+
+#define GFP_KERNEL	0
+
+#define kmalloc(size, flags)	malloc(size)
+#define kfree(ptr)		free(ptr)
+
+#define kvmalloc_array(n, size, flags)	malloc((n) * (size))
+#define kvfree(ptr)			free(ptr)
+
+#define prefetch(ptr)	__builtin_prefetch(ptr)
+
+#define ilog2(n)	(63 - __builtin_clzll(n))
+
+#define min(a, b) ({ typeof(a) __a = (a); typeof(b) __b = (b); __a < __b ? __a : __b; })
+#define max(a, b) ({ typeof(a) __a = (a); typeof(b) __b = (b); __a > __b ? __a : __b; })
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof(a[0]))
+#endif
+
+/* the library is silent in userspace */
+#define pr_info(fmt, ...) do { } while (0)
+
+#endif /* __COMPAT_H */
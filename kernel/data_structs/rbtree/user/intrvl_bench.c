@@ -0,0 +1,365 @@
+/*
+ * intrvl_bench.c - benchmark of the interval tree built in userspace
+ *
+ * Inserts, queries and removes random and clustered intervals and compares
+ * queries with a sorted array + binary search baseline built from the same
+ * (static) set, with the bulk loaded tree and with its frozen Eytzinger
+ * copy.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <malloc.h>
+
+#include "compat.h"
+#include "rbtree.h"
+#include "../intrvl.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+#define MAX_LEN		1024
+#define NR_CLUSTERS	64
+#define CLUSTER_SPAN	(1U << 24)
+
+struct sorted_set {
+	u32 *min;
+	u32 *max;
+	size_t len;
+};
+
+static u64 rnd_state = 88172645463325252ULL;
+
+static u64 rnd(void)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+	return rnd_state;
+}
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static size_t heap_used(void)
+{
+#ifdef __GLIBC__
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+static void gen_random(struct interval *iv, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		u32 len = rnd() % MAX_LEN;
+
+		iv[i].min = rnd() % (U32_MAX - len);
+		iv[i].max = iv[i].min + len;
+	}
+}
+
+static void gen_clustered(struct interval *iv, size_t n)
+{
+	u32 centers[NR_CLUSTERS];
+	size_t i;
+
+	for (i = 0; i < NR_CLUSTERS; i++)
+		centers[i] = rnd() % (U32_MAX - CLUSTER_SPAN);
+
+	for (i = 0; i < n; i++) {
+		u32 len = rnd() % (MAX_LEN / 16);
+
+		iv[i].min = centers[rnd() % NR_CLUSTERS] + rnd() % CLUSTER_SPAN;
+		iv[i].max = iv[i].min + len;
+	}
+}
+
+static void shuffle(struct interval *iv, size_t n)
+{
+	size_t i;
+
+	for (i = n - 1; i > 0; i--) {
+		size_t j = rnd() % (i + 1);
+		struct interval tmp = iv[i];
+
+		iv[i] = iv[j];
+		iv[j] = tmp;
+	}
+}
+
+static int cmp_interval(const void *a, const void *b)
+{
+	const struct interval *x = a, *y = b;
+
+	if (x->min != y->min)
+		return x->min < y->min ? -1 : 1;
+	return 0;
+}
+
+/* coalesce overlapping intervals of the input sorted by min */
+static int sorted_build(struct sorted_set *s, const struct interval *tmp,
+			size_t n)
+{
+	size_t i;
+
+	s->min = malloc(n * sizeof(u32));
+	s->max = malloc(n * sizeof(u32));
+	if (!s->min || !s->max)
+		return -ENOMEM;
+
+	s->len = 0;
+	for (i = 0; i < n; i++) {
+		if (s->len && tmp[i].min <= s->max[s->len - 1]) {
+			s->max[s->len - 1] = max(s->max[s->len - 1], tmp[i].max);
+			continue;
+		}
+
+		s->min[s->len] = tmp[i].min;
+		s->max[s->len] = tmp[i].max;
+		s->len++;
+	}
+
+	return 0;
+}
+
+static bool sorted_search(const struct sorted_set *s, u32 val)
+{
+	size_t lo = 0, hi = s->len;
+
+	/* find the first interval which starts after val */
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (s->min[mid] <= val)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo && s->max[lo - 1] >= val;
+}
+
+static void sorted_free(struct sorted_set *s)
+{
+	free(s->min);
+	free(s->max);
+}
+
+static size_t tree_count(struct rb_root *root)
+{
+	struct rb_node *node;
+	size_t count = 0;
+
+	for (node = rb_first(root); node; node = rb_next(node))
+		count++;
+
+	return count;
+}
+
+static double mlookups(u64 ns, size_t n)
+{
+	return (double)n * 1000 / ns;
+}
+
+static int run_bench(const char *name, struct interval *iv, size_t n)
+{
+	struct rb_root bulk_tree = RB_ROOT;
+	struct rb_root tree = RB_ROOT;
+	struct frozen_intervals frozen = { 0 };
+	struct sorted_set sorted = { 0 };
+	size_t hits_tree = 0, hits_sorted = 0, hits_frozen = 0;
+	struct interval *presorted;
+	size_t heap, count;
+	u32 *points;
+	u64 t0, t1;
+	size_t i;
+	int err;
+
+	points = malloc(n * sizeof(u32));
+	presorted = malloc(n * sizeof(*presorted));
+	if (!points || !presorted) {
+		free(points);
+		free(presorted);
+		return -ENOMEM;
+	}
+
+	/* half of the points hit an inserted interval, half are random */
+	for (i = 0; i < n; i++) {
+		if (i & 1)
+			points[i] = rnd();
+		else
+			points[i] = iv[rnd() % n].min + rnd() % MAX_LEN;
+	}
+
+	printf("%s: %zu intervals\n", name, n);
+
+	heap = heap_used();
+	t0 = now_ns();
+	for (i = 0; i < n; i++) {
+		err = insert_interval(&tree, iv[i].min, iv[i].max, false);
+		if (err)
+			goto out;
+	}
+	t1 = now_ns();
+	heap = heap_used() - heap;
+	count = tree_count(&tree);
+
+	printf("  rbtree insert: %8.1f ns/op, %zu disjoint intervals, %.1f bytes/interval\n",
+	       (double)(t1 - t0) / n, count, (double)heap / count);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		hits_tree += !!search_interval(&tree, points[i]);
+	t1 = now_ns();
+
+	printf("  rbtree query:  %8.1f ns/op, %6.1f Mlookups/s\n",
+	       (double)(t1 - t0) / n, mlookups(t1 - t0, n));
+
+	memcpy(presorted, iv, n * sizeof(*presorted));
+	t0 = now_ns();
+	qsort(presorted, n, sizeof(*presorted), cmp_interval);
+	t1 = now_ns();
+
+	printf("  input sort:    %8.1f ns/op\n", (double)(t1 - t0) / n);
+
+	heap = heap_used();
+	t0 = now_ns();
+	err = build_tree(&bulk_tree, presorted, n);
+	if (err)
+		goto out;
+	t1 = now_ns();
+	heap = heap_used() - heap;
+
+	printf("  rbtree bulk:   %8.1f ns/op (presorted), %.1f bytes/interval\n",
+	       (double)(t1 - t0) / n, (double)heap / tree_count(&bulk_tree));
+
+	t0 = now_ns();
+	err = freeze_tree(&bulk_tree, &frozen);
+	if (err)
+		goto out;
+	t1 = now_ns();
+
+	printf("  frozen build:  %8.1f ns/op, %.1f bytes/interval\n",
+	       (double)(t1 - t0) / n, (double)sizeof(*frozen.iv));
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		hits_frozen += !!search_frozen(&frozen, points[i]);
+	t1 = now_ns();
+
+	printf("  frozen query:  %8.1f ns/op, %6.1f Mlookups/s\n",
+	       (double)(t1 - t0) / n, mlookups(t1 - t0, n));
+
+	heap = heap_used();
+	t0 = now_ns();
+	err = sorted_build(&sorted, presorted, n);
+	if (err)
+		goto out;
+	t1 = now_ns();
+	heap = heap_used() - heap;
+
+	/* the arrays are sized for the input, before coalescing */
+	printf("  sorted build:  %8.1f ns/op (presorted), %zu disjoint intervals, %.1f bytes/interval\n",
+	       (double)(t1 - t0) / n, sorted.len, (double)heap / sorted.len);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++)
+		hits_sorted += sorted_search(&sorted, points[i]);
+	t1 = now_ns();
+
+	printf("  sorted query:  %8.1f ns/op, %6.1f Mlookups/s\n",
+	       (double)(t1 - t0) / n, mlookups(t1 - t0, n));
+
+	if (hits_tree != hits_sorted || hits_tree != hits_frozen ||
+	    count != sorted.len || count != frozen.len) {
+		fprintf(stderr, "rbtree, frozen and sorted array mismatch\n");
+		err = -1;
+		goto out;
+	}
+
+	shuffle(iv, n);
+
+	t0 = now_ns();
+	for (i = 0; i < n; i++) {
+		err = remove_range(&tree, iv[i].min, iv[i].max);
+		if (err)
+			goto out;
+	}
+	t1 = now_ns();
+
+	printf("  rbtree remove: %8.1f ns/op\n\n", (double)(t1 - t0) / n);
+
+	if (!RB_EMPTY_ROOT(&tree)) {
+		fprintf(stderr, "tree is not empty after removing all intervals\n");
+		err = -1;
+	}
+
+out:
+	sorted_free(&sorted);
+	frozen_free(&frozen);
+	destroy_tree(&bulk_tree);
+	destroy_tree(&tree);
+	free(presorted);
+	free(points);
+	return err;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n intervals] [-s seed]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct interval *iv;
+	size_t n = 1000000;
+	int opt;
+	int err;
+
+	while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			rnd_state = strtoull(optarg, NULL, 10) | 1;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (!n) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	iv = malloc(n * sizeof(*iv));
+	if (!iv) {
+		fprintf(stderr, "Failed to allocate %zu intervals\n", n);
+		return -1;
+	}
+
+	gen_random(iv, n);
+	err = run_bench("random", iv, n);
+	if (err)
+		goto out;
+
+	gen_clustered(iv, n);
+	err = run_bench("clustered", iv, n);
+
+out:
+	free(iv);
+	return err ? -1 : 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * rbtree.c - portable userspace red-black tree
+ */
+
+#include "rbtree.h"
+
+static inline void rb_set_red(struct rb_node *rb)
+{
+	rb->__rb_parent_color &= ~1UL;
+}
+
+static inline void rb_set_black(struct rb_node *rb)
+{
+	rb->__rb_parent_color |= RB_BLACK;
+}
+
+static inline void rb_set_color(struct rb_node *rb, int color)
+{
+	rb->__rb_parent_color = (rb->__rb_parent_color & ~1UL) | color;
+}
+
+static inline void rb_change_child(struct rb_node *old, struct rb_node *new,
+				   struct rb_node *parent, struct rb_root *root)
+{
+	if (parent) {
+		if (parent->rb_left == old)
+			parent->rb_left = new;
+		else
+			parent->rb_right = new;
+	} else {
+		root->rb_node = new;
+	}
+}
+
+static void rb_rotate_left(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *right = node->rb_right;
+	struct rb_node *parent = rb_parent(node);
+
+	node->rb_right = right->rb_left;
+	if (node->rb_right)
+		rb_set_parent(node->rb_right, node);
+
+	right->rb_left = node;
+	rb_set_parent(right, parent);
+	rb_change_child(node, right, parent, root);
+	rb_set_parent(node, right);
+}
+
+static void rb_rotate_right(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *left = node->rb_left;
+	struct rb_node *parent = rb_parent(node);
+
+	node->rb_left = left->rb_right;
+	if (node->rb_left)
+		rb_set_parent(node->rb_left, node);
+
+	left->rb_right = node;
+	rb_set_parent(left, parent);
+	rb_change_child(node, left, parent, root);
+	rb_set_parent(node, left);
+}
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *parent, *gparent;
+
+	while ((parent = rb_parent(node)) && rb_is_red(parent)) {
+		gparent = rb_parent(parent);
+
+		if (parent == gparent->rb_left) {
+			struct rb_node *uncle = gparent->rb_right;
+
+			if (uncle && rb_is_red(uncle)) {
+				rb_set_black(uncle);
+				rb_set_black(parent);
+				rb_set_red(gparent);
+				node = gparent;
+				continue;
+			}
+
+			if (parent->rb_right == node) {
+				rb_rotate_left(parent, root);
+				node = parent;
+				parent = rb_parent(node);
+			}
+
+			rb_set_black(parent);
+			rb_set_red(gparent);
+			rb_rotate_right(gparent, root);
+		} else {
+			struct rb_node *uncle = gparent->rb_left;
+
+			if (uncle && rb_is_red(uncle)) {
+				rb_set_black(uncle);
+				rb_set_black(parent);
+				rb_set_red(gparent);
+				node = gparent;
+				continue;
+			}
+
+			if (parent->rb_left == node) {
+				rb_rotate_right(parent, root);
+				node = parent;
+				parent = rb_parent(node);
+			}
+
+			rb_set_black(parent);
+			rb_set_red(gparent);
+			rb_rotate_left(gparent, root);
+		}
+	}
+
+	rb_set_black(root->rb_node);
+}
+
+static void rb_erase_color(struct rb_node *node, struct rb_node *parent,
+			   struct rb_root *root)
+{
+	struct rb_node *other;
+
+	while ((!node || rb_is_black(node)) && node != root->rb_node) {
+		if (parent->rb_left == node) {
+			other = parent->rb_right;
+			if (rb_is_red(other)) {
+				rb_set_black(other);
+				rb_set_red(parent);
+				rb_rotate_left(parent, root);
+				other = parent->rb_right;
+			}
+
+			if ((!other->rb_left || rb_is_black(other->rb_left)) &&
+			    (!other->rb_right || rb_is_black(other->rb_right))) {
+				rb_set_red(other);
+				node = parent;
+				parent = rb_parent(node);
+				continue;
+			}
+
+			if (!other->rb_right || rb_is_black(other->rb_right)) {
+				rb_set_black(other->rb_left);
+				rb_set_red(other);
+				rb_rotate_right(other, root);
+				other = parent->rb_right;
+			}
+
+			rb_set_color(other, rb_color(parent));
+			rb_set_black(parent);
+			rb_set_black(other->rb_right);
+			rb_rotate_left(parent, root);
+			node = root->rb_node;
+			break;
+		} else {
+			other = parent->rb_left;
+			if (rb_is_red(other)) {
+				rb_set_black(other);
+				rb_set_red(parent);
+				rb_rotate_right(parent, root);
+				other = parent->rb_left;
+			}
+
+			if ((!other->rb_left || rb_is_black(other->rb_left)) &&
+			    (!other->rb_right || rb_is_black(other->rb_right))) {
+				rb_set_red(other);
+				node = parent;
+				parent = rb_parent(node);
+				continue;
+			}
+
+			if (!other->rb_left || rb_is_black(other->rb_left)) {
+				rb_set_black(other->rb_right);
+				rb_set_red(other);
+				rb_rotate_left(other, root);
+				other = parent->rb_left;
+			}
+
+			rb_set_color(other, rb_color(parent));
+			rb_set_black(parent);
+			rb_set_black(other->rb_left);
+			rb_rotate_right(parent, root);
+			node = root->rb_node;
+			break;
+		}
+	}
+
+	if (node)
+		rb_set_black(node);
+}
+
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+	struct rb_node *child, *parent;
+	int color;
+
+	if (!node->rb_left) {
+		child = node->rb_right;
+	} else if (!node->rb_right) {
+		child = node->rb_left;
+	} else {
+		struct rb_node *old = node, *left;
+
+		/* replace the node by its successor */
+		node = node->rb_right;
+		while ((left = node->rb_left))
+			node = left;
+
+		rb_change_child(old, node, rb_parent(old), root);
+
+		child = node->rb_right;
+		parent = rb_parent(node);
+		color = rb_color(node);
+
+		if (parent == old) {
+			parent = node;
+		} else {
+			if (child)
+				rb_set_parent(child, parent);
+			parent->rb_left = child;
+
+			node->rb_right = old->rb_right;
+			rb_set_parent(old->rb_right, node);
+		}
+
+		node->__rb_parent_color = old->__rb_parent_color;
+		node->rb_left = old->rb_left;
+		rb_set_parent(old->rb_left, node);
+
+		goto color;
+	}
+
+	parent = rb_parent(node);
+	color = rb_color(node);
+
+	if (child)
+		rb_set_parent(child, parent);
+	rb_change_child(node, child, parent, root);
+
+color:
+	if (color == RB_BLACK)
+		rb_erase_color(child, parent, root);
+}
+
+struct rb_node *rb_first(const struct rb_root *root)
+{
+	struct rb_node *n = root->rb_node;
+
+	if (!n)
+		return NULL;
+	while (n->rb_left)
+		n = n->rb_left;
+	return n;
+}
+
+struct rb_node *rb_last(const struct rb_root *root)
+{
+	struct rb_node *n = root->rb_node;
+
+	if (!n)
+		return NULL;
+	while (n->rb_right)
+		n = n->rb_right;
+	return n;
+}
+
+struct rb_node *rb_next(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (RB_EMPTY_NODE(node))
+		return NULL;
+
+	if (node->rb_right) {
+		node = node->rb_right;
+		while (node->rb_left)
+			node = node->rb_left;
+		return (struct rb_node *)node;
+	}
+
+	while ((parent = rb_parent(node)) && node == parent->rb_right)
+		node = parent;
+
+	return parent;
+}
+
+struct rb_node *rb_prev(const struct rb_node *node)
+{
+	struct rb_node *parent;
+
+	if (RB_EMPTY_NODE(node))
+		return NULL;
+
+	if (node->rb_left) {
+		node = node->rb_left;
+		while (node->rb_right)
+			node = node->rb_right;
+		return (struct rb_node *)node;
+	}
+
+	while ((parent = rb_parent(node)) && node == parent->rb_left)
+		node = parent;
+
+	return parent;
+}
+
+static struct rb_node *rb_left_deepest_node(const struct rb_node *node)
+{
+	for (;;) {
+		if (node->rb_left)
+			node = node->rb_left;
+		else if (node->rb_right)
+			node = node->rb_right;
+		else
+			return (struct rb_node *)node;
+	}
+}
+
+struct rb_node *rb_next_postorder(const struct rb_node *node)
+{
+	const struct rb_node *parent;
+
+	if (!node)
+		return NULL;
+
+	parent = rb_parent(node);
+
+	/* if we're sitting on node, we've already seen our children */
+	if (parent && node == parent->rb_left && parent->rb_right)
+		return rb_left_deepest_node(parent->rb_right);
+
+	return (struct rb_node *)parent;
+}
+
+struct rb_node *rb_first_postorder(const struct rb_root *root)
+{
+	if (!root->rb_node)
+		return NULL;
+
+	return rb_left_deepest_node(root->rb_node);
+}
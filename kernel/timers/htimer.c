@@ -9,20 +9,49 @@
 #include <linux/interrupt.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/list.h>
+#include <linux/math64.h>
 
 #include <asm/uaccess.h>
 
 #define MS_TO_NS(x) ((x) * 1000000)
 
+#define HT_HIST_BUCKETS 64
+
 static struct proc_dir_entry *ht_dir;
 
 /* there variables are configurable via /proc/htimer/ entries */
 static unsigned long delay_ms = 200L;
 static int loop = 5;
+static unsigned int timers = 100;
+static unsigned long slack_us = 1000L;
 
 enum htimer_var {
 	HT_VAR_LOOP,
 	HT_VAR_DELAY,
+	HT_VAR_TIMERS,
+	HT_VAR_SLACK,
+};
+
+enum htimer_mode {
+	/* each timer expires exactly at its deadline */
+	HT_MODE_EXACT,
+	/* range timers which may expire up to slack after the deadline */
+	HT_MODE_SLACK,
+	/* timers within the same slack window share one hrtimer */
+	HT_MODE_GROUP,
+	HT_MODE_MAX,
+};
+
+static const char * const htimer_mode_names[HT_MODE_MAX] = {
+	[HT_MODE_EXACT] = "exact",
+	[HT_MODE_SLACK] = "slack",
+	[HT_MODE_GROUP] = "grouped",
 };
 
 struct htimer_obj {
@@ -33,6 +62,42 @@ struct htimer_obj {
 	int loops;
 };
 
+/* log2 histogram of the expiry lateness in ns, bucket i is [2^(i-1), 2^i) */
+struct htimer_hist {
+	u64 buckets[HT_HIST_BUCKETS];
+	u64 count;
+	s64 max;
+	/* hrtimer interrupts which expired at least one of our timers */
+	u64 irqs;
+	unsigned int last_event;
+};
+
+struct htimer_batch {
+	wait_queue_head_t wait;
+	atomic_t active;
+};
+
+struct htimer_lat {
+	struct htimer_batch *batch;
+	struct hrtimer timer;
+	/* group mode only */
+	struct list_head entry;
+	ktime_t deadline;
+	unsigned long delay;
+	int loops;
+};
+
+struct htimer_group {
+	struct hrtimer timer;
+	struct list_head members;
+	ktime_t expires;
+	unsigned long delay;
+};
+
+static DEFINE_PER_CPU(struct htimer_hist, ht_hist);
+/* histograms are shared, so only one latency run at a time */
+static DEFINE_MUTEX(ht_lat_lock);
+
 static int ht_var_proc_show(struct seq_file *m, void *v)
 {
 	switch ((long)m->private) {
@@ -43,6 +108,14 @@ static int ht_var_proc_show(struct seq_file *m, void *v)
 	case HT_VAR_DELAY:
 		seq_printf(m, "%lu\n", delay_ms);
 		break;
+
+	case HT_VAR_TIMERS:
+		seq_printf(m, "%u\n", timers);
+		break;
+
+	case HT_VAR_SLACK:
+		seq_printf(m, "%lu\n", slack_us);
+		break;
 	}
 
 	return 0;
@@ -84,6 +157,30 @@ static ssize_t ht_var_proc_write(struct file *file, const char __user *buf,
 			delay_ms = val;
 		}
 		break;
+
+	case HT_VAR_TIMERS:
+		{
+			unsigned int val;
+
+			if (kstrtouint_from_user(buf, count, 10, &val) || !val) {
+				pr_err("ht_var_proc_write: failed parse timers value\n");
+				return -EINVAL;
+			}
+			timers = val;
+		}
+		break;
+
+	case HT_VAR_SLACK:
+		{
+			unsigned long int val;
+
+			if (kstrtoul_from_user(buf, count, 10, &val)) {
+				pr_err("ht_var_proc_write: failed parse slack value\n");
+				return -EINVAL;
+			}
+			slack_us = val;
+		}
+		break;
 	}
 
 	return count;
@@ -197,6 +294,347 @@ static const struct file_operations ht_timer_fops = {
 	.release = single_release,
 };
 
+static void htimer_hist_add(struct htimer_hist *h, s64 ns)
+{
+	int b = ns > 0 ? fls64(ns) : 0;
+
+	h->buckets[min(b, HT_HIST_BUCKETS - 1)]++;
+	h->count++;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+/* upper bound of the bucket where the given percentile falls into */
+static u64 htimer_hist_percentile(struct htimer_hist *h, unsigned int pct)
+{
+	u64 want = div_u64(h->count * pct + 99, 100);
+	u64 sum = 0;
+	int b;
+
+	for (b = 0; b < HT_HIST_BUCKETS; b++) {
+		sum += h->buckets[b];
+		if (sum >= want)
+			return b ? 1ULL << b : 0;
+	}
+
+	return 0;
+}
+
+static void htimer_hist_merge(struct htimer_hist *to, struct htimer_hist *from)
+{
+	int b;
+
+	for (b = 0; b < HT_HIST_BUCKETS; b++)
+		to->buckets[b] += from->buckets[b];
+
+	to->count += from->count;
+	to->max = max(to->max, from->max);
+	to->irqs += from->irqs;
+}
+
+static void htimer_hist_reset(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&ht_hist, cpu), 0, sizeof(struct htimer_hist));
+}
+
+static void htimer_hist_total(struct htimer_hist *total)
+{
+	int cpu;
+
+	memset(total, 0, sizeof(*total));
+
+	for_each_possible_cpu(cpu)
+		htimer_hist_merge(total, per_cpu_ptr(&ht_hist, cpu));
+}
+
+/* timers expired by the same hrtimer interrupt see the same nr_events */
+static void htimer_count_irq(struct htimer_hist *h, struct hrtimer *t)
+{
+#ifdef CONFIG_HIGH_RES_TIMERS
+	unsigned int event = t->base->cpu_base->nr_events;
+
+	if (h->irqs && h->last_event == event)
+		return;
+	h->last_event = event;
+#endif
+	h->irqs++;
+}
+
+static void htimer_hist_dump(struct seq_file *m, const char *name,
+			     struct htimer_hist *h)
+{
+	seq_printf(m, "%4s  %10llu  %10llu  %10llu  %10lld\n", name, h->count,
+		   htimer_hist_percentile(h, 50),
+		   htimer_hist_percentile(h, 99), h->max);
+}
+
+static void htimer_lat_done(struct htimer_lat *lt)
+{
+	if (atomic_dec_and_test(&lt->batch->active))
+		wake_up_interruptible(&lt->batch->wait);
+}
+
+static enum hrtimer_restart htimer_lat_fn(struct hrtimer *t)
+{
+	struct htimer_lat *lt = container_of(t, struct htimer_lat, timer);
+	struct htimer_hist *h = this_cpu_ptr(&ht_hist);
+	/* the soft expiry is the deadline, range timers may fire after it */
+	ktime_t late = ktime_sub(ktime_get(), hrtimer_get_softexpires(t));
+
+	htimer_count_irq(h, t);
+	htimer_hist_add(h, ktime_to_ns(late));
+
+	if (--lt->loops > 0) {
+		hrtimer_forward_now(t, ns_to_ktime(MS_TO_NS(lt->delay)));
+		return HRTIMER_RESTART;
+	}
+
+	htimer_lat_done(lt);
+	return HRTIMER_NORESTART;
+}
+
+static enum hrtimer_restart htimer_group_fn(struct hrtimer *t)
+{
+	struct htimer_group *g = container_of(t, struct htimer_group, timer);
+	struct htimer_hist *h = this_cpu_ptr(&ht_hist);
+	struct htimer_lat *lt, *tmp;
+	ktime_t now = ktime_get();
+	u64 overruns;
+
+	htimer_count_irq(h, t);
+
+	/* members skip the same periods as the group if it was late */
+	overruns = hrtimer_forward_now(t, ns_to_ktime(MS_TO_NS(g->delay)));
+
+	list_for_each_entry_safe(lt, tmp, &g->members, entry) {
+		htimer_hist_add(h, ktime_to_ns(ktime_sub(now, lt->deadline)));
+		lt->deadline = ktime_add_ns(lt->deadline,
+					    overruns * MS_TO_NS(lt->delay));
+
+		if (--lt->loops > 0)
+			continue;
+
+		list_del(&lt->entry);
+		htimer_lat_done(lt);
+	}
+
+	return list_empty(&g->members) ? HRTIMER_NORESTART : HRTIMER_RESTART;
+}
+
+/*
+ * Arm all the timers with the first deadlines spread over one period, so
+ * they fire concurrently but not all at once, and wait until each of them
+ * fired loop times. In the group mode the timers are not armed, instead
+ * the ones with deadlines in the same slack window are expired together
+ * by the group hrtimer at the end of the window.
+ */
+static int htimer_lat_run(struct htimer_lat *lts, struct htimer_group *groups,
+			  unsigned int nr, enum htimer_mode mode,
+			  struct htimer_batch *batch, u64 *elapsed)
+{
+	u64 slack_ns = max_t(u64, (u64)slack_us * NSEC_PER_USEC, 1);
+	struct htimer_group *g = NULL;
+	unsigned int nr_groups = 0;
+	ktime_t start;
+	unsigned int i;
+
+	if (mode >= HT_MODE_MAX)
+		return -EINVAL;
+
+	init_waitqueue_head(&batch->wait);
+	atomic_set(&batch->active, nr);
+
+	start = ktime_get();
+
+	for (i = 0; i < nr; i++) {
+		struct htimer_lat *lt = &lts[i];
+		u64 first = MS_TO_NS(delay_ms) +
+			    div_u64(MS_TO_NS((u64)delay_ms) * i, nr);
+		ktime_t window;
+
+		lt->batch = batch;
+		lt->delay = delay_ms;
+		lt->loops = loop;
+		lt->deadline = ktime_add_ns(start, first);
+
+		switch (mode) {
+		case HT_MODE_EXACT:
+		case HT_MODE_SLACK:
+			hrtimer_init(&lt->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+			lt->timer.function = htimer_lat_fn;
+			hrtimer_start_range_ns(&lt->timer, lt->deadline,
+					       mode == HT_MODE_SLACK ? slack_ns : 0,
+					       HRTIMER_MODE_ABS);
+			break;
+
+		case HT_MODE_GROUP:
+			window = ktime_add_ns(start,
+					      div64_u64(first + slack_ns - 1,
+							slack_ns) * slack_ns);
+
+			if (!g || ktime_compare(g->expires, window)) {
+				g = &groups[nr_groups++];
+				hrtimer_init(&g->timer, CLOCK_MONOTONIC,
+					     HRTIMER_MODE_ABS);
+				g->timer.function = htimer_group_fn;
+				INIT_LIST_HEAD(&g->members);
+				g->expires = window;
+				g->delay = delay_ms;
+			}
+			list_add_tail(&lt->entry, &g->members);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	for (i = 0; i < nr_groups; i++)
+		hrtimer_start(&groups[i].timer, groups[i].expires,
+			      HRTIMER_MODE_ABS);
+
+	wait_event_interruptible(batch->wait, !atomic_read(&batch->active));
+	*elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (mode == HT_MODE_GROUP) {
+		for (i = 0; i < nr_groups; i++)
+			hrtimer_cancel(&groups[i].timer);
+	} else {
+		for (i = 0; i < nr; i++)
+			hrtimer_cancel(&lts[i].timer);
+	}
+
+	return signal_pending(current) ? -ERESTARTSYS : 0;
+}
+
+static int ht_latency_proc_show(struct seq_file *seq, void *v)
+{
+	struct htimer_hist total = { };
+	struct htimer_batch batch;
+	struct htimer_lat *lts;
+	unsigned int nr = timers;
+	u64 elapsed;
+	char name[8];
+	int cpu;
+	int ret;
+
+	if (loop < 1)
+		return -EINVAL;
+
+	lts = kvmalloc_array(nr, sizeof(*lts), GFP_KERNEL);
+	if (!lts)
+		return -ENOMEM;
+
+	if (mutex_lock_interruptible(&ht_lat_lock)) {
+		ret = -ERESTARTSYS;
+		goto out;
+	}
+
+	htimer_hist_reset();
+
+	ret = htimer_lat_run(lts, NULL, nr, HT_MODE_EXACT, &batch, &elapsed);
+	if (ret)
+		goto unlock;
+
+	seq_printf(seq, "timers=%u loops=%d delay=%lu ms\n", nr, loop, delay_ms);
+	seq_puts(seq, " cpu       count     p50(ns)     p99(ns)     max(ns)\n");
+
+	for_each_possible_cpu(cpu) {
+		struct htimer_hist *h = per_cpu_ptr(&ht_hist, cpu);
+
+		if (!h->count)
+			continue;
+
+		snprintf(name, sizeof(name), "%d", cpu);
+		htimer_hist_dump(seq, name, h);
+		htimer_hist_merge(&total, h);
+	}
+	htimer_hist_dump(seq, "all", &total);
+
+unlock:
+	mutex_unlock(&ht_lat_lock);
+out:
+	kvfree(lts);
+	return ret;
+}
+
+static int ht_latency_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ht_latency_proc_show, NULL);
+}
+
+static const struct file_operations ht_latency_fops = {
+	.open = ht_latency_proc_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int ht_coalesce_proc_show(struct seq_file *seq, void *v)
+{
+	struct htimer_group *groups;
+	struct htimer_batch batch;
+	struct htimer_hist total;
+	struct htimer_lat *lts;
+	unsigned int nr = timers;
+	enum htimer_mode mode;
+	u64 elapsed;
+	int ret = -ENOMEM;
+
+	if (loop < 1)
+		return -EINVAL;
+
+	lts = kvmalloc_array(nr, sizeof(*lts), GFP_KERNEL);
+	groups = kvmalloc_array(nr, sizeof(*groups), GFP_KERNEL);
+	if (!lts || !groups)
+		goto out;
+
+	if (mutex_lock_interruptible(&ht_lat_lock)) {
+		ret = -ERESTARTSYS;
+		goto out;
+	}
+
+	seq_printf(seq, "timers=%u loops=%d delay=%lu ms slack=%lu us\n",
+		   nr, loop, delay_ms, slack_us);
+	seq_puts(seq, "mode          irqs/s     p50(ns)     p99(ns)     max(ns)\n");
+
+	for (mode = HT_MODE_EXACT; mode < HT_MODE_MAX; mode++) {
+		htimer_hist_reset();
+
+		ret = htimer_lat_run(lts, groups, nr, mode, &batch, &elapsed);
+		if (ret)
+			break;
+
+		htimer_hist_total(&total);
+		seq_printf(seq, "%-8s  %10llu  %10llu  %10llu  %10lld\n",
+			   htimer_mode_names[mode],
+			   div64_u64(total.irqs * NSEC_PER_SEC, max(elapsed, 1ULL)),
+			   htimer_hist_percentile(&total, 50),
+			   htimer_hist_percentile(&total, 99), total.max);
+	}
+
+	mutex_unlock(&ht_lat_lock);
+out:
+	kvfree(groups);
+	kvfree(lts);
+	return ret;
+}
+
+static int ht_coalesce_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ht_coalesce_proc_show, NULL);
+}
+
+static const struct file_operations ht_coalesce_fops = {
+	.open = ht_coalesce_proc_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int htimer_init(void)
 {
 	ht_dir = proc_mkdir("htimer", NULL);
@@ -207,7 +645,11 @@ static int htimer_init(void)
 
 	proc_create_data("loop", 0644, ht_dir, &ht_var_fops, (void *)HT_VAR_LOOP);
 	proc_create_data("delay", 0644, ht_dir, &ht_var_fops, (void *)HT_VAR_DELAY);
+	proc_create_data("timers", 0644, ht_dir, &ht_var_fops, (void *)HT_VAR_TIMERS);
+	proc_create_data("slack", 0644, ht_dir, &ht_var_fops, (void *)HT_VAR_SLACK);
 	proc_create("timer", 0, ht_dir, &ht_timer_fops);
+	proc_create("latency", 0, ht_dir, &ht_latency_fops);
+	proc_create("coalesce", 0, ht_dir, &ht_coalesce_fops);
 
 	pr_info("HR timer initialized\n");
 
@@ -0,0 +1,457 @@
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/completion.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+
+/*
+ * Hierarchical timer wheel for many coarse timeouts. The root level has a
+ * slot per tick, each upper level slot covers a whole turn of the level
+ * below it and is cascaded down when the lower level wraps. All of them are
+ * driven by a single hrtimer tick, so adding and cancelling a timeout is an
+ * O(1) list operation.
+ */
+
+#define TW_ROOT_BITS	8
+#define TW_ROOT_SIZE	(1 << TW_ROOT_BITS)
+#define TW_ROOT_MASK	(TW_ROOT_SIZE - 1)
+#define TW_LVL_BITS	6
+#define TW_LVL_SIZE	(1 << TW_LVL_BITS)
+#define TW_LVL_MASK	(TW_LVL_SIZE - 1)
+#define TW_LEVELS	3
+#define TW_MAX_TICKS	(1ULL << (TW_ROOT_BITS + TW_LEVELS * TW_LVL_BITS))
+
+#define BENCH_EXPIRE_MS	100
+
+static unsigned int tick_us = 1000;
+module_param(tick_us, uint, 0444);
+MODULE_PARM_DESC(tick_us, "Timer wheel tick in microseconds");
+
+static unsigned int max_timers = 1000000;
+module_param(max_timers, uint, 0444);
+MODULE_PARM_DESC(max_timers, "Maximum number of timers to benchmark");
+
+struct tw_timer {
+	struct hlist_node entry;
+	u64 expires;
+	void (*fn)(struct tw_timer *t);
+};
+
+struct timer_wheel {
+	spinlock_t lock;
+	struct hrtimer tick;
+	u64 tick_ns;
+	u64 base_ns;
+	/* next tick to be processed */
+	u64 now;
+	unsigned long pending;
+	bool ticking;
+	struct hlist_head root[TW_ROOT_SIZE];
+	struct hlist_head lvl[TW_LEVELS][TW_LVL_SIZE];
+};
+
+static struct timer_wheel wheel;
+
+static inline u64 tw_cur_tick(struct timer_wheel *w)
+{
+	return div64_u64(ktime_get_ns() - w->base_ns, w->tick_ns);
+}
+
+static void tw_enqueue(struct timer_wheel *w, struct tw_timer *t)
+{
+	struct hlist_head *vec;
+	u64 idx;
+	int lvl;
+
+	if (t->expires < w->now)
+		t->expires = w->now;
+	if (t->expires - w->now >= TW_MAX_TICKS)
+		t->expires = w->now + TW_MAX_TICKS - 1;
+
+	idx = t->expires - w->now;
+
+	if (idx < TW_ROOT_SIZE) {
+		vec = &w->root[t->expires & TW_ROOT_MASK];
+	} else {
+		for (lvl = 0; lvl < TW_LEVELS - 1; lvl++) {
+			if (idx < 1ULL << (TW_ROOT_BITS + (lvl + 1) * TW_LVL_BITS))
+				break;
+		}
+
+		vec = &w->lvl[lvl][(t->expires >>
+				    (TW_ROOT_BITS + lvl * TW_LVL_BITS)) & TW_LVL_MASK];
+	}
+
+	hlist_add_head(&t->entry, vec);
+}
+
+/* move the timers of the current slot at lvl one level down */
+static int tw_cascade(struct timer_wheel *w, int lvl)
+{
+	int idx = (w->now >> (TW_ROOT_BITS + lvl * TW_LVL_BITS)) & TW_LVL_MASK;
+	struct hlist_node *tmp;
+	struct tw_timer *t;
+	HLIST_HEAD(list);
+
+	hlist_move_list(&w->lvl[lvl][idx], &list);
+
+	hlist_for_each_entry_safe(t, tmp, &list, entry)
+		tw_enqueue(w, t);
+
+	return idx;
+}
+
+/* called with the lock held, drops it while running the callbacks */
+static void tw_run(struct timer_wheel *w, u64 target)
+{
+	while (w->now <= target) {
+		int idx = w->now & TW_ROOT_MASK;
+		HLIST_HEAD(work);
+
+		if (!idx && !tw_cascade(w, 0) && !tw_cascade(w, 1))
+			tw_cascade(w, 2);
+
+		hlist_move_list(&w->root[idx], &work);
+		w->now++;
+
+		while (!hlist_empty(&work)) {
+			struct tw_timer *t = hlist_entry(work.first,
+							 struct tw_timer, entry);
+
+			hlist_del_init(&t->entry);
+			w->pending--;
+
+			spin_unlock(&w->lock);
+			t->fn(t);
+			spin_lock(&w->lock);
+		}
+	}
+}
+
+static enum hrtimer_restart tw_tick_fn(struct hrtimer *tick)
+{
+	struct timer_wheel *w = container_of(tick, struct timer_wheel, tick);
+
+	spin_lock(&w->lock);
+
+	tw_run(w, tw_cur_tick(w));
+
+	/* nothing to wait for, the next add will start ticking again */
+	if (!w->pending) {
+		w->ticking = false;
+		spin_unlock(&w->lock);
+		return HRTIMER_NORESTART;
+	}
+
+	spin_unlock(&w->lock);
+
+	hrtimer_forward_now(tick, ns_to_ktime(w->tick_ns));
+	return HRTIMER_RESTART;
+}
+
+static void tw_init(struct timer_wheel *w, u64 tick_ns)
+{
+	int i, j;
+
+	spin_lock_init(&w->lock);
+
+	for (i = 0; i < TW_ROOT_SIZE; i++)
+		INIT_HLIST_HEAD(&w->root[i]);
+	for (i = 0; i < TW_LEVELS; i++)
+		for (j = 0; j < TW_LVL_SIZE; j++)
+			INIT_HLIST_HEAD(&w->lvl[i][j]);
+
+	w->tick_ns = tick_ns;
+	w->base_ns = ktime_get_ns();
+	w->now = 0;
+	w->pending = 0;
+	w->ticking = false;
+
+	hrtimer_init(&w->tick, CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+	w->tick.function = tw_tick_fn;
+}
+
+static void tw_destroy(struct timer_wheel *w)
+{
+	hrtimer_cancel(&w->tick);
+}
+
+static void tw_timer_init(struct tw_timer *t, void (*fn)(struct tw_timer *t))
+{
+	INIT_HLIST_NODE(&t->entry);
+	t->fn = fn;
+}
+
+static inline bool tw_timer_pending(struct tw_timer *t)
+{
+	return !hlist_unhashed(&t->entry);
+}
+
+/* (re)arm the timer to fire at the given tick */
+static void tw_timer_add_at(struct timer_wheel *w, struct tw_timer *t,
+			    u64 expires)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&w->lock, flags);
+
+	if (tw_timer_pending(t)) {
+		hlist_del_init(&t->entry);
+		w->pending--;
+	}
+
+	/* the wheel is empty, so skip all the idle ticks */
+	if (!w->ticking)
+		w->now = tw_cur_tick(w);
+
+	t->expires = expires;
+	tw_enqueue(w, t);
+	w->pending++;
+
+	if (!w->ticking) {
+		w->ticking = true;
+		hrtimer_start(&w->tick, ns_to_ktime(w->tick_ns),
+			      HRTIMER_MODE_REL_PINNED);
+	}
+
+	spin_unlock_irqrestore(&w->lock, flags);
+}
+
+/*
+ * (re)arm the timer to fire after timeout_ns with the tick granularity, the
+ * deadline is rounded up to a tick boundary so it never fires early
+ */
+static void tw_timer_add(struct timer_wheel *w, struct tw_timer *t,
+			 u64 timeout_ns)
+{
+	u64 deadline = ktime_get_ns() - w->base_ns + timeout_ns;
+
+	tw_timer_add_at(w, t, div64_u64(deadline + w->tick_ns - 1, w->tick_ns));
+}
+
+/* does not wait for the callback if it is already running */
+static bool tw_timer_cancel(struct timer_wheel *w, struct tw_timer *t)
+{
+	unsigned long flags;
+	bool pending;
+
+	spin_lock_irqsave(&w->lock, flags);
+
+	pending = tw_timer_pending(t);
+	if (pending) {
+		hlist_del_init(&t->entry);
+		w->pending--;
+	}
+
+	spin_unlock_irqrestore(&w->lock, flags);
+	return pending;
+}
+
+struct bench_state {
+	struct completion done;
+	atomic_t fired;
+	unsigned int nr;
+	u64 first;
+	u64 last;
+	u32 seed;
+};
+
+struct bench_hrtimer {
+	struct hrtimer timer;
+};
+
+static struct bench_state bench;
+
+static inline u32 bench_rand(void)
+{
+	bench.seed ^= bench.seed << 13;
+	bench.seed ^= bench.seed >> 17;
+	bench.seed ^= bench.seed << 5;
+	return bench.seed;
+}
+
+/* random timeout far enough to not fire while measuring arm/cancel */
+static inline u64 bench_timeout_ns(void)
+{
+	return NSEC_PER_SEC + (bench_rand() % NSEC_PER_SEC);
+}
+
+static void bench_reset(unsigned int nr)
+{
+	init_completion(&bench.done);
+	atomic_set(&bench.fired, 0);
+	bench.nr = nr;
+	bench.first = 0;
+	bench.last = 0;
+}
+
+static void bench_expired(void)
+{
+	u64 now = ktime_get_ns();
+	unsigned int fired = atomic_inc_return(&bench.fired);
+
+	if (fired == 1)
+		bench.first = now;
+	bench.last = now;
+
+	if (fired == bench.nr)
+		complete(&bench.done);
+}
+
+/* all the timers fire together, so report the cost of one expiry */
+static int bench_wait_expired(u64 *expire)
+{
+	unsigned long timeout = msecs_to_jiffies(BENCH_EXPIRE_MS + 10000);
+
+	if (!wait_for_completion_timeout(&bench.done, timeout)) {
+		pr_err("Timer wheel: %d of %u timers expired in time\n",
+		       atomic_read(&bench.fired), bench.nr);
+		return -ETIMEDOUT;
+	}
+
+	*expire = div_u64(bench.last - bench.first, max(bench.nr - 1, 1U));
+	return 0;
+}
+
+static void bench_tw_fn(struct tw_timer *t)
+{
+	bench_expired();
+}
+
+static enum hrtimer_restart bench_hrtimer_fn(struct hrtimer *t)
+{
+	bench_expired();
+	return HRTIMER_NORESTART;
+}
+
+static int bench_twheel(unsigned int nr, u64 *arm, u64 *cancel, u64 *expire)
+{
+	struct tw_timer *timers;
+	unsigned int i;
+	u64 t0;
+	int err;
+
+	timers = kvmalloc_array(nr, sizeof(*timers), GFP_KERNEL);
+	if (!timers)
+		return -ENOMEM;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < nr; i++) {
+		tw_timer_init(&timers[i], bench_tw_fn);
+		tw_timer_add(&wheel, &timers[i], bench_timeout_ns());
+	}
+	*arm = div_u64(ktime_get_ns() - t0, nr);
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < nr; i++)
+		tw_timer_cancel(&wheel, &timers[i]);
+	*cancel = div_u64(ktime_get_ns() - t0, nr);
+
+	/* same expiry tick for all of them */
+	bench_reset(nr);
+	t0 = tw_cur_tick(&wheel) +
+	     div64_u64(BENCH_EXPIRE_MS * NSEC_PER_MSEC, wheel.tick_ns);
+	for (i = 0; i < nr; i++)
+		tw_timer_add_at(&wheel, &timers[i], t0);
+	err = bench_wait_expired(expire);
+
+	for (i = 0; i < nr; i++)
+		tw_timer_cancel(&wheel, &timers[i]);
+
+	kvfree(timers);
+	return err;
+}
+
+static int bench_hrtimers(unsigned int nr, u64 *arm, u64 *cancel, u64 *expire)
+{
+	struct bench_hrtimer *timers;
+	unsigned int i;
+	u64 t0;
+	int err;
+
+	timers = kvmalloc_array(nr, sizeof(*timers), GFP_KERNEL);
+	if (!timers)
+		return -ENOMEM;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < nr; i++) {
+		hrtimer_init(&timers[i].timer, CLOCK_MONOTONIC,
+			     HRTIMER_MODE_REL_PINNED);
+		timers[i].timer.function = bench_hrtimer_fn;
+		hrtimer_start(&timers[i].timer, ns_to_ktime(bench_timeout_ns()),
+			      HRTIMER_MODE_REL_PINNED);
+	}
+	*arm = div_u64(ktime_get_ns() - t0, nr);
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < nr; i++)
+		hrtimer_cancel(&timers[i].timer);
+	*cancel = div_u64(ktime_get_ns() - t0, nr);
+
+	/* same absolute expiry for all of them */
+	bench_reset(nr);
+	t0 = ktime_get_ns() + BENCH_EXPIRE_MS * NSEC_PER_MSEC;
+	for (i = 0; i < nr; i++)
+		hrtimer_start(&timers[i].timer, ns_to_ktime(t0),
+			      HRTIMER_MODE_ABS_PINNED);
+	err = bench_wait_expired(expire);
+
+	for (i = 0; i < nr; i++)
+		hrtimer_cancel(&timers[i].timer);
+
+	kvfree(timers);
+	return err;
+}
+
+static int twheel_init(void)
+{
+	unsigned int nr;
+	int err = 0;
+
+	pr_info("Timer wheel: init (tick %u us)\n", tick_us);
+
+	tw_init(&wheel, (u64)tick_us * NSEC_PER_USEC);
+	bench.seed = 2463534242U;
+
+	for (nr = 10000; nr <= max_timers; nr *= 10) {
+		u64 tw_arm, tw_cancel, tw_expire;
+		u64 hr_arm, hr_cancel, hr_expire;
+
+		err = bench_twheel(nr, &tw_arm, &tw_cancel, &tw_expire);
+		if (err)
+			break;
+		err = bench_hrtimers(nr, &hr_arm, &hr_cancel, &hr_expire);
+		if (err)
+			break;
+
+		pr_info("%8u timers: twheel arm=%llu cancel=%llu expire=%llu ns, hrtimer arm=%llu cancel=%llu expire=%llu ns\n",
+			nr, tw_arm, tw_cancel, tw_expire,
+			hr_arm, hr_cancel, hr_expire);
+	}
+
+	if (err)
+		tw_destroy(&wheel);
+	return err;
+}
+
+static void twheel_exit(void)
+{
+	tw_destroy(&wheel);
+
+	pr_info("Timer wheel: exit\n");
+}
+
+module_init(twheel_init);
+module_exit(twheel_exit);
+
+MODULE_AUTHOR("Vadim Kochan <vadim4j@gmail.com>");
+MODULE_DESCRIPTION("Hierarchical timer wheel demo");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,258 @@
+/*
+ * utimer.c - many timers multiplexed onto one timerfd
+ *
+ * The timers are kept in a 4-ary min-heap and the timerfd is programmed
+ * only to the earliest expiry, so one wakeup (read + settime) serves all
+ * the timers expired by that time.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "utimer.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+#define HEAP_ARITY	4
+
+uint64_t utimer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static inline void heap_set(struct utimer_engine *e, size_t i, struct utimer *t)
+{
+	e->heap[i] = t;
+	t->idx = i;
+}
+
+static void heap_sift_up(struct utimer_engine *e, size_t i)
+{
+	struct utimer *t = e->heap[i];
+
+	while (i) {
+		size_t parent = (i - 1) / HEAP_ARITY;
+
+		if (e->heap[parent]->expires <= t->expires)
+			break;
+
+		heap_set(e, i, e->heap[parent]);
+		i = parent;
+	}
+
+	heap_set(e, i, t);
+}
+
+static void heap_sift_down(struct utimer_engine *e, size_t i)
+{
+	struct utimer *t = e->heap[i];
+
+	for (;;) {
+		size_t first = i * HEAP_ARITY + 1;
+		size_t last = first + HEAP_ARITY;
+		size_t min = i;
+		uint64_t min_expires = t->expires;
+		size_t c;
+
+		if (last > e->len)
+			last = e->len;
+
+		for (c = first; c < last; c++) {
+			if (e->heap[c]->expires < min_expires) {
+				min = c;
+				min_expires = e->heap[c]->expires;
+			}
+		}
+
+		if (min == i)
+			break;
+
+		heap_set(e, i, e->heap[min]);
+		i = min;
+	}
+
+	heap_set(e, i, t);
+}
+
+static void heap_remove(struct utimer_engine *e, struct utimer *t)
+{
+	size_t i = t->idx;
+	struct utimer *last = e->heap[--e->len];
+
+	t->idx = UTIMER_IDLE;
+	if (last == t)
+		return;
+
+	heap_set(e, i, last);
+	if (i && e->heap[(i - 1) / HEAP_ARITY]->expires > last->expires)
+		heap_sift_up(e, i);
+	else
+		heap_sift_down(e, i);
+}
+
+static int heap_grow(struct utimer_engine *e)
+{
+	size_t size = e->size ? e->size * 2 : 64;
+	struct utimer **heap;
+
+	heap = realloc(e->heap, size * sizeof(*heap));
+	if (!heap)
+		return -ENOMEM;
+
+	e->heap = heap;
+	e->size = size;
+	return 0;
+}
+
+/* program the timerfd to the earliest expiry if it changed */
+static int utimer_reprogram(struct utimer_engine *e)
+{
+	struct itimerspec its = { 0 };
+	uint64_t expires;
+
+	if (!e->len)
+		return 0;
+
+	expires = e->heap[0]->expires;
+	if (expires == e->armed)
+		return 0;
+
+	its.it_value.tv_sec = expires / NSEC_IN_SEC;
+	its.it_value.tv_nsec = expires % NSEC_IN_SEC;
+
+	e->nr_syscalls++;
+	if (timerfd_settime(e->tfd, TFD_TIMER_ABSTIME, &its, NULL))
+		return -errno;
+
+	e->armed = expires;
+	return 0;
+}
+
+int utimer_engine_init(struct utimer_engine *e)
+{
+	e->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (e->tfd < 0)
+		return -errno;
+
+	e->heap = NULL;
+	e->len = 0;
+	e->size = 0;
+	e->armed = 0;
+	e->nr_syscalls = 0;
+	e->nr_wakeups = 0;
+	return 0;
+}
+
+void utimer_engine_destroy(struct utimer_engine *e)
+{
+	close(e->tfd);
+	free(e->heap);
+}
+
+void utimer_init(struct utimer *t, utimer_fn_t fn)
+{
+	t->expires = 0;
+	t->period = 0;
+	t->fn = fn;
+	t->idx = UTIMER_IDLE;
+}
+
+int utimer_add(struct utimer_engine *e, struct utimer *t, uint64_t expires,
+	       uint64_t period)
+{
+	if (utimer_pending(t))
+		return utimer_mod(e, t, expires, period);
+
+	if (e->len == e->size && heap_grow(e))
+		return -ENOMEM;
+
+	t->expires = expires;
+	t->period = period;
+
+	heap_set(e, e->len++, t);
+	heap_sift_up(e, t->idx);
+
+	/* only an earlier expiry needs the timerfd to be reprogrammed */
+	if (t->idx == 0 && (!e->armed || expires < e->armed))
+		return utimer_reprogram(e);
+	return 0;
+}
+
+int utimer_mod(struct utimer_engine *e, struct utimer *t, uint64_t expires,
+	       uint64_t period)
+{
+	uint64_t old = t->expires;
+
+	if (!utimer_pending(t))
+		return utimer_add(e, t, expires, period);
+
+	t->expires = expires;
+	t->period = period;
+
+	if (expires < old)
+		heap_sift_up(e, t->idx);
+	else
+		heap_sift_down(e, t->idx);
+
+	if (t->idx == 0 && (!e->armed || expires < e->armed))
+		return utimer_reprogram(e);
+	return 0;
+}
+
+/*
+ * The timerfd is left as is, a wakeup for a cancelled timer is cheaper
+ * than a syscall per cancel.
+ */
+bool utimer_cancel(struct utimer_engine *e, struct utimer *t)
+{
+	if (!utimer_pending(t))
+		return false;
+
+	heap_remove(e, t);
+	return true;
+}
+
+/* wait for the earliest expiry and run all the expired timers */
+int utimer_engine_run(struct utimer_engine *e)
+{
+	uint64_t ticks;
+	uint64_t now;
+
+	/* would block forever */
+	if (!e->len && !e->armed)
+		return -ENOENT;
+
+	e->nr_syscalls++;
+	if (read(e->tfd, &ticks, sizeof(ticks)) < 0 && errno != EINTR)
+		return -errno;
+
+	e->nr_wakeups++;
+	e->armed = 0;
+	now = utimer_now();
+
+	while (e->len && e->heap[0]->expires <= now) {
+		struct utimer *t = e->heap[0];
+		uint64_t expires = t->expires;
+
+		if (t->period) {
+			/* skip the periods which were missed */
+			t->expires += t->period;
+			if (t->expires <= now)
+				t->expires += ((now - t->expires) / t->period + 1) *
+					      t->period;
+			heap_sift_down(e, 0);
+		} else {
+			heap_remove(e, t);
+		}
+
+		t->fn(t, expires);
+	}
+
+	return utimer_reprogram(e);
+}
@@ -0,0 +1,58 @@
+/*
+ * utimer.h - many timers multiplexed onto one timerfd
+ */
+
+#ifndef __UTIMER_H
+#define __UTIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define UTIMER_IDLE	((size_t)-1)
+
+struct utimer;
+
+typedef void (*utimer_fn_t)(struct utimer *t, uint64_t expires);
+
+struct utimer {
+	/* absolute CLOCK_MONOTONIC time in ns */
+	uint64_t expires;
+	/* re-armed by this period after expiry, 0 for one-shot */
+	uint64_t period;
+	utimer_fn_t fn;
+	/* position in the heap or UTIMER_IDLE */
+	size_t idx;
+};
+
+struct utimer_engine {
+	int tfd;
+	/* 4-ary min-heap ordered by expires */
+	struct utimer **heap;
+	size_t len;
+	size_t size;
+	/* expiry the timerfd is currently programmed to, 0 if disarmed */
+	uint64_t armed;
+	uint64_t nr_syscalls;
+	uint64_t nr_wakeups;
+};
+
+uint64_t utimer_now(void);
+
+int utimer_engine_init(struct utimer_engine *e);
+void utimer_engine_destroy(struct utimer_engine *e);
+int utimer_engine_run(struct utimer_engine *e);
+
+void utimer_init(struct utimer *t, utimer_fn_t fn);
+int utimer_add(struct utimer_engine *e, struct utimer *t, uint64_t expires,
+	       uint64_t period);
+int utimer_mod(struct utimer_engine *e, struct utimer *t, uint64_t expires,
+	       uint64_t period);
+bool utimer_cancel(struct utimer_engine *e, struct utimer *t);
+
+static inline bool utimer_pending(struct utimer *t)
+{
+	return t->idx != UTIMER_IDLE;
+}
+
+#endif /* __UTIMER_H */
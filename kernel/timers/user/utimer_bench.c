@@ -0,0 +1,385 @@
+/*
+ * utimer_bench.c - timer expiry lateness with one timerfd per thread vs one
+ * timerfd per timer
+ *
+ * Each thread is pinned to a CPU and runs its own set of periodic timers
+ * either on the utimer engine (4-ary heap over one timerfd) or with a
+ * timerfd per timer waited by epoll, lateness of every expiry goes into a
+ * log2 histogram.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+
+#include "utimer.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+#define NSEC_IN_MSEC	1000000ULL
+
+#define HIST_BUCKETS	64
+#define MAX_EVENTS	256
+
+#define MIN_PERIOD_MS	1
+#define MAX_PERIOD_MS	20
+
+/* log2 histogram of lateness in ns, bucket i is [2^(i-1), 2^i) */
+struct hist {
+	uint64_t buckets[HIST_BUCKETS];
+	uint64_t count;
+	uint64_t max;
+};
+
+struct bench_timer {
+	struct utimer t;
+	struct hist *hist;
+	uint64_t next;
+	uint64_t period;
+	int fd;
+};
+
+struct bench_thread {
+	pthread_t tid;
+	int cpu;
+	int (*run)(struct bench_thread *bt);
+	uint32_t seed;
+	struct hist hist;
+	uint64_t expiries;
+	uint64_t syscalls;
+	uint64_t wakeups;
+	int err;
+} __attribute__((aligned(64)));
+
+static unsigned int nr_timers = 1000;
+static unsigned int duration_s = 2;
+
+static inline uint32_t bench_rand(struct bench_thread *bt)
+{
+	bt->seed ^= bt->seed << 13;
+	bt->seed ^= bt->seed >> 17;
+	bt->seed ^= bt->seed << 5;
+	return bt->seed;
+}
+
+static void hist_add(struct hist *h, int64_t ns)
+{
+	int b = ns > 0 ? 64 - __builtin_clzll(ns) : 0;
+
+	h->buckets[b < HIST_BUCKETS ? b : HIST_BUCKETS - 1]++;
+	h->count++;
+	if (ns > 0 && (uint64_t)ns > h->max)
+		h->max = ns;
+}
+
+static void hist_merge(struct hist *to, struct hist *from)
+{
+	int b;
+
+	for (b = 0; b < HIST_BUCKETS; b++)
+		to->buckets[b] += from->buckets[b];
+
+	to->count += from->count;
+	if (from->max > to->max)
+		to->max = from->max;
+}
+
+/* upper bound of the bucket where the given percentile falls into */
+static uint64_t hist_percentile(struct hist *h, unsigned int pct)
+{
+	uint64_t want = (h->count * pct + 99) / 100;
+	uint64_t sum = 0;
+	int b;
+
+	for (b = 0; b < HIST_BUCKETS; b++) {
+		sum += h->buckets[b];
+		if (sum >= want)
+			return b ? 1ULL << b : 0;
+	}
+
+	return 0;
+}
+
+static uint64_t bench_period(struct bench_thread *bt)
+{
+	return (MIN_PERIOD_MS + bench_rand(bt) % (MAX_PERIOD_MS - MIN_PERIOD_MS + 1)) *
+	       NSEC_IN_MSEC;
+}
+
+static void bench_utimer_fn(struct utimer *t, uint64_t expires)
+{
+	struct bench_timer *bt = (struct bench_timer *)t;
+
+	hist_add(bt->hist, utimer_now() - expires);
+}
+
+static int run_utimer(struct bench_thread *th)
+{
+	struct utimer_engine e;
+	struct bench_timer *timers;
+	uint64_t start, stop;
+	unsigned int i;
+	int err;
+
+	timers = calloc(nr_timers, sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	err = utimer_engine_init(&e);
+	if (err)
+		goto out;
+
+	start = utimer_now();
+	stop = start + duration_s * NSEC_IN_SEC;
+
+	for (i = 0; i < nr_timers; i++) {
+		uint64_t period = bench_period(th);
+
+		timers[i].hist = &th->hist;
+		utimer_init(&timers[i].t, bench_utimer_fn);
+
+		err = utimer_add(&e, &timers[i].t,
+				 start + bench_rand(th) % period, period);
+		if (err)
+			goto destroy;
+	}
+
+	while (utimer_now() < stop) {
+		err = utimer_engine_run(&e);
+		if (err)
+			goto destroy;
+	}
+
+	for (i = 0; i < nr_timers; i++)
+		utimer_cancel(&e, &timers[i].t);
+
+	th->expiries = th->hist.count;
+	th->syscalls = e.nr_syscalls;
+	th->wakeups = e.nr_wakeups;
+
+destroy:
+	utimer_engine_destroy(&e);
+out:
+	free(timers);
+	return err;
+}
+
+static int run_timerfd(struct bench_thread *th)
+{
+	struct epoll_event events[MAX_EVENTS];
+	struct bench_timer *timers;
+	uint64_t start, stop;
+	unsigned int i;
+	int err = 0;
+	int epfd;
+
+	timers = calloc(nr_timers, sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_timers; i++)
+		timers[i].fd = -1;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd < 0) {
+		err = -errno;
+		goto out;
+	}
+
+	start = utimer_now();
+	stop = start + duration_s * NSEC_IN_SEC;
+
+	for (i = 0; i < nr_timers; i++) {
+		struct bench_timer *bt = &timers[i];
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = bt };
+		struct itimerspec its;
+
+		bt->period = bench_period(th);
+		bt->next = start + bench_rand(th) % bt->period;
+
+		its.it_value.tv_sec = bt->next / NSEC_IN_SEC;
+		its.it_value.tv_nsec = bt->next % NSEC_IN_SEC;
+		its.it_interval.tv_sec = bt->period / NSEC_IN_SEC;
+		its.it_interval.tv_nsec = bt->period % NSEC_IN_SEC;
+
+		bt->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (bt->fd < 0 ||
+		    timerfd_settime(bt->fd, TFD_TIMER_ABSTIME, &its, NULL) ||
+		    epoll_ctl(epfd, EPOLL_CTL_ADD, bt->fd, &ev)) {
+			err = -errno;
+			goto close;
+		}
+	}
+
+	while (utimer_now() < stop) {
+		int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+
+		th->syscalls++;
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err = -errno;
+			goto close;
+		}
+		th->wakeups++;
+
+		for (i = 0; i < n; i++) {
+			struct bench_timer *bt = events[i].data.ptr;
+			uint64_t ticks;
+
+			th->syscalls++;
+			if (read(bt->fd, &ticks, sizeof(ticks)) != sizeof(ticks))
+				continue;
+
+			hist_add(&th->hist, utimer_now() - bt->next);
+			bt->next += ticks * bt->period;
+		}
+	}
+
+	th->expiries = th->hist.count;
+
+close:
+	for (i = 0; i < nr_timers; i++) {
+		if (timers[i].fd >= 0)
+			close(timers[i].fd);
+	}
+	close(epfd);
+out:
+	free(timers);
+	return err;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *th = arg;
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(th->cpu, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+	th->err = th->run(th);
+	return NULL;
+}
+
+static int run_bench(const char *name, int (*run)(struct bench_thread *bt),
+		     unsigned int nr_threads)
+{
+	struct bench_thread *threads;
+	long nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t expiries = 0, syscalls = 0, wakeups = 0;
+	struct hist total;
+	unsigned int i;
+	int err = 0;
+
+	threads = aligned_alloc(64, nr_threads * sizeof(*threads));
+	if (!threads)
+		return -ENOMEM;
+
+	memset(threads, 0, nr_threads * sizeof(*threads));
+	memset(&total, 0, sizeof(total));
+
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].cpu = i % nr_cpus;
+		threads[i].run = run;
+		threads[i].seed = 2463534242U + i;
+
+		if (pthread_create(&threads[i].tid, NULL, bench_thread_fn,
+				   &threads[i])) {
+			fprintf(stderr, "Failed create thread #%u\n", i);
+			nr_threads = i;
+			err = -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i].tid, NULL);
+
+		if (threads[i].err) {
+			fprintf(stderr, "%s: thread #%u failed: %s\n", name, i,
+				strerror(-threads[i].err));
+			err = threads[i].err;
+		}
+
+		hist_merge(&total, &threads[i].hist);
+		expiries += threads[i].expiries;
+		syscalls += threads[i].syscalls;
+		wakeups += threads[i].wakeups;
+	}
+
+	if (!err && expiries) {
+		printf("%-8s expiries/s=%-9lu wakeups/s=%-9lu syscalls/expiry=%.3f lateness p50=%lu p99=%lu max=%lu ns\n",
+		       name, expiries / duration_s, wakeups / duration_s,
+		       (double)syscalls / expiries,
+		       hist_percentile(&total, 50), hist_percentile(&total, 99),
+		       total.max);
+	}
+
+	free(threads);
+	return err;
+}
+
+/* a timerfd per timer needs a lot of descriptors */
+static void raise_nofile(void)
+{
+	struct rlimit rl;
+
+	if (!getrlimit(RLIMIT_NOFILE, &rl)) {
+		rl.rlim_cur = rl.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &rl);
+	}
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t threads] [-n timers per thread] [-d seconds]\n",
+	       prog);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nr_threads = 2;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:d:h")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = strtoul(optarg, NULL, 10);
+			break;
+		case 'n':
+			nr_timers = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			duration_s = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (!nr_threads || !nr_timers || !duration_s) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	raise_nofile();
+
+	printf("threads=%u timers/thread=%u period=%u..%u ms\n", nr_threads,
+	       nr_timers, MIN_PERIOD_MS, MAX_PERIOD_MS);
+
+	if (run_bench("utimer", run_utimer, nr_threads))
+		return -1;
+	if (run_bench("timerfd", run_timerfd, nr_threads))
+		return -1;
+
+	return 0;
+}
@@ -1,17 +1,81 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
 #include <pthread.h>
 
-pthread_t th0, th1;
+#define MAX_THREADS	256
+#define NSEC_IN_SEC	1000000000ULL
 
-int count = 100000;
-int val = 0;
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+struct worker {
+	pthread_t tid;
+	int id;
+	int cpu;
+};
+
+struct inc_mode {
+	const char *name;
+	void *(*inc)(void *arg);
+	/* the total after all the threads are done */
+	long (*sum)(int nr_threads);
+};
+
+struct padded64 {
+	volatile long val;
+} __attribute__((aligned(64)));
+
+struct padded128 {
+	volatile long val;
+} __attribute__((aligned(128)));
+
+struct padded_atomic {
+	atomic_long val;
+} __attribute__((aligned(64)));
+
+static struct worker workers[MAX_THREADS];
+/* the CPUs we are allowed to run on, threads are pinned round robin */
+static int cpu_list[CPU_SETSIZE];
+static int nr_cpus;
+
+static long count = 10000000;
+static long val = 0;
+
+/* per-thread counters, next to each other in the same cache lines */
+static volatile long packed[MAX_THREADS] __attribute__((aligned(64)));
+static struct padded64 padded64[MAX_THREADS];
+static struct padded128 padded128[MAX_THREADS];
+static long local_sum;
+
+/* the C11 variants, shared and per-thread ones */
+static atomic_long cval;
+static struct padded_atomic own[MAX_THREADS];
+
+static int nr_ready;
+static volatile bool start;
+
+static void wait_start(void)
+{
+	__sync_fetch_and_add(&nr_ready, 1);
+	while (!start)
+		cpu_relax();
+}
 
 void *inc_nonatomic(void *arg)
 {
-	int i;
+	long i, n = count;
 
-	for (i = 0; i < count; i++) {
-		val++;
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		(*(volatile long *)&val)++;
 	}
 
 	return NULL;
@@ -19,75 +83,501 @@ void *inc_nonatomic(void *arg)
 
 void *inc_atomic(void *arg)
 {
-	int i;
+	long i, n = count;
 
-	for (i = 0; i < count; i++) {
+	wait_start();
+
+	for (i = 0; i < n; i++) {
 		__sync_fetch_and_add(&val, 1);
 	}
 
 	return NULL;
 }
 
-int run_threads(void * (*inc)(void *arg))
+void *inc_cas(void *arg)
 {
-	int err = 0;
+	long i, n = count;
 
-	err = pthread_create(&th0, NULL, inc, NULL);
-	if (err) {
-		fprintf(stderr, "Failed create thread th0\n");
-		return err;
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		long old = *(volatile long *)&val;
+		long cur;
+
+		while ((cur = __sync_val_compare_and_swap(&val, old, old + 1))
+		       != old)
+			old = cur;
 	}
 
-	err = pthread_create(&th1, NULL, inc, NULL);
-	if (err) {
-		fprintf(stderr, "Failed create thread th1\n");
-		return err;
+	return NULL;
+}
+
+void *inc_packed(void *arg)
+{
+	struct worker *w = arg;
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		packed[w->id]++;
 	}
 
-	return 0;
+	return NULL;
 }
 
-int wait_threads(void)
+void *inc_padded64(void *arg)
 {
-	int err;
+	struct worker *w = arg;
+	long i, n = count;
 
-	err = pthread_join(th0, NULL);
-	if (err) {
-		fprintf(stderr, "Failed join for thread th0\n");
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		padded64[w->id].val++;
 	}
 
-	err = pthread_join(th1, NULL);
-	if (err) {
-		fprintf(stderr, "Failed join for thread th1\n");
-		return err;
+	return NULL;
+}
+
+void *inc_padded128(void *arg)
+{
+	struct worker *w = arg;
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		padded128[w->id].val++;
 	}
 
-	return err;
+	return NULL;
 }
 
-int main(int argc, char **argv)
+/* counter in the thread's own TLS, added to the total once at the end */
+static __thread volatile long local;
+
+void *inc_local(void *arg)
 {
-	int err = 0;
+	long i, n = count;
 
-	printf("Run non-atomic incrementing with 2 threads:\n");
+	wait_start();
 
-	if (run_threads(inc_nonatomic))
-		return -1;
-	if (wait_threads())
-		return -1;
+	for (i = 0; i < n; i++) {
+		local++;
+	}
 
-	printf("\tActual=%d, Expected=%d\n", val, count * 2);
+	__sync_fetch_and_add(&local_sum, local);
+	return NULL;
+}
 
-	printf("\n");
-	printf("Run atomic incrementing with 2 threads:\n");
+/*
+ * The same increments with the C11 and the __atomic orderings. On x86 any
+ * locked RMW is a full barrier, so the ordering only matters for the plain
+ * stores below (seq_cst store needs xchg or mfence).
+ */
+void *inc_c11_relaxed(void *arg)
+{
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		atomic_fetch_add_explicit(&cval, 1, memory_order_relaxed);
+	}
+
+	return NULL;
+}
+
+void *inc_c11_acq_rel(void *arg)
+{
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		atomic_fetch_add_explicit(&cval, 1, memory_order_acq_rel);
+	}
+
+	return NULL;
+}
+
+void *inc_c11_seq_cst(void *arg)
+{
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		atomic_fetch_add_explicit(&cval, 1, memory_order_seq_cst);
+	}
+
+	return NULL;
+}
+
+void *inc_builtin_relaxed(void *arg)
+{
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		__atomic_fetch_add(&val, 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+void *inc_builtin_seq_cst(void *arg)
+{
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		__atomic_fetch_add(&val, 1, __ATOMIC_SEQ_CST);
+	}
+
+	return NULL;
+}
+
+/* uncontended: each thread has its own atomic counter line */
+void *inc_own_rmw(void *arg)
+{
+	struct worker *w = arg;
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		atomic_fetch_add_explicit(&own[w->id].val, 1,
+					  memory_order_relaxed);
+	}
+
+	return NULL;
+}
+
+/* the single writer doesn't need RMW, readers still see whole values */
+void *inc_own_store_relaxed(void *arg)
+{
+	atomic_long *v = &own[((struct worker *)arg)->id].val;
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		atomic_store_explicit(v, atomic_load_explicit(v,
+					memory_order_relaxed) + 1,
+				      memory_order_relaxed);
+	}
+
+	return NULL;
+}
+
+void *inc_own_store_seq_cst(void *arg)
+{
+	atomic_long *v = &own[((struct worker *)arg)->id].val;
+	long i, n = count;
+
+	wait_start();
+
+	for (i = 0; i < n; i++) {
+		atomic_store(v, atomic_load(v) + 1);
+	}
+
+	return NULL;
+}
+
+static long sum_shared(int nr_threads)
+{
+	return val;
+}
+
+static long sum_packed(int nr_threads)
+{
+	long sum = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		sum += packed[i];
+
+	return sum;
+}
+
+static long sum_padded64(int nr_threads)
+{
+	long sum = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		sum += padded64[i].val;
+
+	return sum;
+}
+
+static long sum_padded128(int nr_threads)
+{
+	long sum = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		sum += padded128[i].val;
+
+	return sum;
+}
+
+static long sum_local(int nr_threads)
+{
+	return local_sum;
+}
+
+static long sum_c11(int nr_threads)
+{
+	return atomic_load(&cval);
+}
+
+static long sum_own(int nr_threads)
+{
+	long sum = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++)
+		sum += atomic_load(&own[i].val);
+
+	return sum;
+}
+
+static const struct inc_mode modes[] = {
+	{ "nonatomic", inc_nonatomic, sum_shared },
+	{ "fetch-add", inc_atomic, sum_shared },
+	{ "cas-loop", inc_cas, sum_shared },
+	{ "packed", inc_packed, sum_packed },
+	{ "padded64", inc_padded64, sum_padded64 },
+	{ "padded128", inc_padded128, sum_padded128 },
+	{ "local", inc_local, sum_local },
+	{ "c11-relaxed", inc_c11_relaxed, sum_c11 },
+	{ "c11-acq_rel", inc_c11_acq_rel, sum_c11 },
+	{ "c11-seq_cst", inc_c11_seq_cst, sum_c11 },
+	{ "atomic-relaxed", inc_builtin_relaxed, sum_shared },
+	{ "atomic-seq_cst", inc_builtin_seq_cst, sum_shared },
+	{ "own-rmw", inc_own_rmw, sum_own },
+	{ "own-st-relaxed", inc_own_store_relaxed, sum_own },
+	{ "own-st-seq_cst", inc_own_store_seq_cst, sum_own },
+};
+
+#define NR_MODES	(sizeof(modes) / sizeof(modes[0]))
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void reset_counters(void)
+{
+	int i;
 
 	val = 0;
+	local_sum = 0;
+	memset((void *)packed, 0, sizeof(packed));
+	memset(padded64, 0, sizeof(padded64));
+	memset(padded128, 0, sizeof(padded128));
+	atomic_store(&cval, 0);
+	for (i = 0; i < MAX_THREADS; i++)
+		atomic_store(&own[i].val, 0);
+}
+
+static int get_cpus(void)
+{
+	cpu_set_t cpus;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus))
+		return -1;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus))
+			cpu_list[nr_cpus++] = cpu;
+	}
+
+	return nr_cpus ? 0 : -1;
+}
+
+int run_threads(void * (*inc)(void *arg), int nr_threads)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int err = 0;
+	int i;
+
+	nr_ready = 0;
+	start = false;
+
+	pthread_attr_init(&attr);
+
+	for (i = 0; i < nr_threads; i++) {
+		struct worker *w = &workers[i];
+
+		w->id = i;
+		w->cpu = cpu_list[i % nr_cpus];
+
+		CPU_ZERO(&cpus);
+		CPU_SET(w->cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+		err = pthread_create(&w->tid, &attr, inc, w);
+		if (err) {
+			fprintf(stderr, "Failed create thread %d\n", i);
+			break;
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+	return err ? i : nr_threads;
+}
+
+int wait_threads(int nr_threads)
+{
+	int err = 0;
+	int i;
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_join(workers[i].tid, NULL)) {
+			fprintf(stderr, "Failed join for thread %d\n", i);
+			err = -1;
+		}
+	}
+
+	return err;
+}
+
+/* returns the run time in ns or 0 on error */
+static uint64_t run_mode(const struct inc_mode *mode, int nr_threads,
+			 long *lost)
+{
+	uint64_t t0, t1;
+	int started;
+
+	reset_counters();
+
+	started = run_threads(mode->inc, nr_threads);
+	if (started == nr_threads) {
+		while (__sync_fetch_and_add(&nr_ready, 0) < nr_threads)
+			cpu_relax();
+	}
+
+	t0 = now_ns();
+	start = true;
+
+	if (wait_threads(started) || started != nr_threads)
+		return 0;
+	t1 = now_ns();
+
+	*lost = (long)nr_threads * count - mode->sum(nr_threads);
+	return t1 > t0 ? t1 - t0 : 1;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t max threads] [-n increments per thread] [-m mode] [-l]\n",
+	       prog);
+	printf("  -l  print the latency of an increment in ns instead of Mops/s\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *only = NULL;
+	bool latency = false;
+	int max_threads = 0;
+	int nr_threads;
+	size_t m;
+	int opt;
 
-	if (run_threads(inc_atomic))
+	if (get_cpus()) {
+		fprintf(stderr, "Failed to get the CPUs\n");
 		return -1;
-	if (wait_threads())
+	}
+
+	while ((opt = getopt(argc, argv, "t:n:m:lh")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'n':
+			count = atol(optarg);
+			break;
+		case 'm':
+			only = optarg;
+			break;
+		case 'l':
+			latency = true;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (!max_threads)
+		max_threads = nr_cpus < MAX_THREADS ? nr_cpus : MAX_THREADS;
+
+	if (max_threads < 1 || max_threads > MAX_THREADS) {
+		fprintf(stderr, "Threads must be 1..%d\n", MAX_THREADS);
 		return -1;
+	}
+
+	printf("%ld increments per thread, %d CPUs (%s)\n", count, nr_cpus,
+	       latency ? "ns per increment" : "Mops/s");
+	printf("%-14s", "threads");
+	for (nr_threads = 1; ; nr_threads *= 2) {
+		if (nr_threads > max_threads)
+			nr_threads = max_threads;
+		printf("  %8d", nr_threads);
+		if (nr_threads == max_threads)
+			break;
+	}
+	printf("\n");
+
+	for (m = 0; m < NR_MODES; m++) {
+		long max_lost = 0;
+
+		if (only && strcmp(only, modes[m].name))
+			continue;
+
+		printf("%-14s", modes[m].name);
+
+		for (nr_threads = 1; ; nr_threads *= 2) {
+			uint64_t ns;
+			long lost;
+
+			if (nr_threads > max_threads)
+				nr_threads = max_threads;
+
+			ns = run_mode(&modes[m], nr_threads, &lost);
+			if (!ns)
+				return -1;
+
+			/* every thread did count increments in that time */
+			if (latency)
+				printf("  %8.2f", (double)ns / count);
+			else
+				printf("  %8.1f",
+				       (double)nr_threads * count * 1000 / ns);
+			fflush(stdout);
+
+			if (lost > max_lost)
+				max_lost = lost;
+
+			if (nr_threads == max_threads)
+				break;
+		}
+
+		if (max_lost)
+			printf("  (lost up to %ld increments)", max_lost);
+		printf("\n");
+	}
 
-	printf("\tActual=%d, Expected=%d\n", val, count * 2);
 	return 0;
 }
@@ -0,0 +1,292 @@
+/*
+ * barrier_bench.c - per-episode latency of the thread barriers
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tbarrier.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+#define MAX_THREADS	256
+
+struct barrier_ops {
+	const char *name;
+	int (*init)(int nr);
+	void (*wait)(int id);
+	void (*destroy)(void);
+};
+
+struct bench_thread {
+	pthread_t tid;
+	int id;
+	int cpu;
+	/* checks that nobody passes an episode before all arrive */
+	long episode __attribute__((aligned(64)));
+};
+
+static struct central_barrier central;
+static struct tree_barrier tree;
+static struct dissemination_barrier dissemination;
+static pthread_barrier_t pthread_barrier;
+
+static const struct barrier_ops *ops;
+static struct bench_thread threads[MAX_THREADS];
+static int nr_threads;
+static long nr_episodes = 100000;
+static volatile int failed;
+/* taken by thread 0 */
+static uint64_t t_start, t_end;
+
+static int cpu_list[CPU_SETSIZE];
+static int nr_cpus;
+
+static int central_init(int nr)
+{
+	return central_barrier_init(&central, nr);
+}
+
+static void central_wait(int id)
+{
+	central_barrier_wait(&central, id);
+}
+
+static void central_destroy(void)
+{
+	central_barrier_destroy(&central);
+}
+
+static int tree_init(int nr)
+{
+	return tree_barrier_init(&tree, nr);
+}
+
+static void tree_wait(int id)
+{
+	tree_barrier_wait(&tree, id);
+}
+
+static void tree_destroy(void)
+{
+	tree_barrier_destroy(&tree);
+}
+
+static int dissemination_init(int nr)
+{
+	return dissemination_barrier_init(&dissemination, nr);
+}
+
+static void dissemination_wait(int id)
+{
+	dissemination_barrier_wait(&dissemination, id);
+}
+
+static void dissemination_destroy(void)
+{
+	dissemination_barrier_destroy(&dissemination);
+}
+
+static int pthread_init(int nr)
+{
+	return pthread_barrier_init(&pthread_barrier, NULL, nr) ? -1 : 0;
+}
+
+static void pthread_wait(int id)
+{
+	pthread_barrier_wait(&pthread_barrier);
+}
+
+static void pthread_destroy(void)
+{
+	pthread_barrier_destroy(&pthread_barrier);
+}
+
+static const struct barrier_ops barriers[] = {
+	{ "central", central_init, central_wait, central_destroy },
+	{ "tree", tree_init, tree_wait, tree_destroy },
+	{ "dissemination", dissemination_init, dissemination_wait,
+	  dissemination_destroy },
+	{ "pthread", pthread_init, pthread_wait, pthread_destroy },
+};
+
+#define NR_BARRIERS	(sizeof(barriers) / sizeof(barriers[0]))
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+	struct bench_thread *t = arg;
+	long e;
+
+	/* the first episode lines everyone up, the clock starts after it */
+	ops->wait(t->id);
+	if (t->id == 0)
+		t_start = now_ns();
+	ops->wait(t->id);
+
+	for (e = 0; e < nr_episodes; e++) {
+		int next = (t->id + 1) % nr_threads;
+
+		__atomic_store_n(&t->episode, e + 1, __ATOMIC_RELAXED);
+		ops->wait(t->id);
+
+		/* everyone has arrived at this episode before we left it */
+		if (__atomic_load_n(&threads[next].episode,
+				    __ATOMIC_RELAXED) < e + 1)
+			failed = 1;
+	}
+
+	/* the last episode released everyone */
+	if (t->id == 0)
+		t_end = now_ns();
+
+	return NULL;
+}
+
+/* ns per episode or -1 */
+static double run_bench(const struct barrier_ops *b, int nr)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int i, started;
+
+	if (b->init(nr)) {
+		fprintf(stderr, "%s: failed to init for %d threads\n",
+			b->name, nr);
+		return -1;
+	}
+
+	ops = b;
+	nr_threads = nr;
+	failed = 0;
+
+	pthread_attr_init(&attr);
+
+	for (started = 0; started < nr; started++) {
+		struct bench_thread *t = &threads[started];
+
+		t->id = started;
+		t->cpu = cpu_list[started % nr_cpus];
+		t->episode = 0;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(t->cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+		if (pthread_create(&t->tid, &attr, bench_thread_fn, t)) {
+			fprintf(stderr, "Failed create thread %d\n", started);
+			/* the started ones would wait for the rest forever */
+			exit(-1);
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i].tid, NULL);
+
+	b->destroy();
+
+	if (failed) {
+		fprintf(stderr, "%s: a thread passed the barrier early\n",
+			b->name);
+		return -1;
+	}
+
+	/* the episodes and the one after the clock was started */
+	return (double)(t_end - t_start) / (nr_episodes + 1);
+}
+
+static int get_cpus(void)
+{
+	cpu_set_t cpus;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus))
+		return -1;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus))
+			cpu_list[nr_cpus++] = cpu;
+	}
+
+	return nr_cpus ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t max threads] [-e episodes]\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = 0;
+	size_t b;
+	int nr, opt;
+
+	while ((opt = getopt(argc, argv, "t:e:h")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'e':
+			nr_episodes = atol(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (get_cpus()) {
+		fprintf(stderr, "Failed to get the CPUs\n");
+		return -1;
+	}
+
+	if (!max_threads)
+		max_threads = nr_cpus < 2 ? 2 : nr_cpus;
+	if (max_threads < 2 || max_threads > MAX_THREADS || nr_episodes < 1) {
+		fprintf(stderr, "Threads must be 2..%d\n", MAX_THREADS);
+		return -1;
+	}
+
+	printf("%ld episodes, %d CPUs (ns per episode)\n", nr_episodes,
+	       nr_cpus);
+	printf("%-8s", "threads");
+	for (b = 0; b < NR_BARRIERS; b++)
+		printf("  %14s", barriers[b].name);
+	printf("\n");
+
+	for (nr = 2; ; nr *= 2) {
+		if (nr > max_threads)
+			nr = max_threads;
+
+		printf("%-8d", nr);
+		for (b = 0; b < NR_BARRIERS; b++) {
+			double ns = run_bench(&barriers[b], nr);
+
+			if (ns < 0)
+				return -1;
+			printf("  %14.1f", ns);
+			fflush(stdout);
+		}
+		printf("\n");
+
+		if (nr == max_threads)
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,462 @@
+/*
+ * litmus.c - memory ordering litmus tests
+ *
+ * Each test runs its threads over millions of trials, every trial uses its
+ * own fresh variables and starts after a spinning barrier, so there are no
+ * syscalls on the way. The outcome of every trial (the values loaded, or
+ * the final values for 2+2W) is counted, the one which needs a reordering
+ * is marked with '*'. On x86 (TSO) only SB can be relaxed and only if there
+ * is no full fence between the store and the load.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tbarrier.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+
+#define MAX_THREADS	4
+#define MAX_REGS	4
+/* outcome values are 0..2, so 3^MAX_REGS outcomes */
+#define MAX_OUTCOMES	81
+/* trials between the tallies */
+#define BATCH		10000
+
+#define compiler_barrier() __asm__ __volatile__("" ::: "memory")
+
+enum fence_kind {
+	FENCE_NONE,
+	FENCE_MFENCE,
+	FENCE_SYNC,
+	FENCE_C11_SEQ_CST,
+	FENCE_C11_ACQ_REL,
+	FENCE_LOCK,
+	NR_FENCES,
+};
+
+static const char * const fence_names[NR_FENCES] = {
+	[FENCE_NONE] = "none",
+	[FENCE_MFENCE] = "mfence",
+	[FENCE_SYNC] = "__sync",
+	[FENCE_C11_SEQ_CST] = "c11-seq_cst",
+	[FENCE_C11_ACQ_REL] = "c11-acq_rel",
+	[FENCE_LOCK] = "lock-add",
+};
+
+struct litmus_ctx {
+	volatile int *x;
+	volatile int *y;
+	/* loaded values, r[reg][trial] */
+	int *r[MAX_REGS];
+	enum fence_kind fence;
+};
+
+struct litmus {
+	const char *name;
+	int nr_threads;
+	int nr_regs;
+	void (*thread[MAX_THREADS])(struct litmus_ctx *c, size_t i);
+	/* the final values of x and y are the outcome instead of loads */
+	bool final;
+	/* the outcome which needs the reordering */
+	int relaxed[MAX_REGS];
+	const char *desc;
+};
+
+struct litmus_thread {
+	pthread_t tid;
+	int id;
+	int cpu;
+};
+
+/*
+ * The fence is picked in the loop, the kind is loop invariant so the
+ * branch is always predicted and the trials are not slowed by calls.
+ */
+static inline void fence(enum fence_kind kind)
+{
+	switch (kind) {
+	case FENCE_NONE:
+		compiler_barrier();
+		break;
+	case FENCE_MFENCE:
+		__asm__ __volatile__("mfence" ::: "memory");
+		break;
+	case FENCE_SYNC:
+		__sync_synchronize();
+		break;
+	case FENCE_C11_SEQ_CST:
+		atomic_thread_fence(memory_order_seq_cst);
+		break;
+	case FENCE_C11_ACQ_REL:
+		atomic_thread_fence(memory_order_acq_rel);
+		break;
+	case FENCE_LOCK:
+		__asm__ __volatile__("lock; addl $0,0(%%rsp)" ::: "memory", "cc");
+		break;
+	default:
+		break;
+	}
+}
+
+/* SB: x = 1; r0 = y || y = 1; r1 = x */
+static void sb0(struct litmus_ctx *c, size_t i)
+{
+	c->x[i] = 1;
+	fence(c->fence);
+	c->r[0][i] = c->y[i];
+}
+
+static void sb1(struct litmus_ctx *c, size_t i)
+{
+	c->y[i] = 1;
+	fence(c->fence);
+	c->r[1][i] = c->x[i];
+}
+
+/* MP: x = 1; y = 1 || r0 = y; r1 = x */
+static void mp0(struct litmus_ctx *c, size_t i)
+{
+	c->x[i] = 1;
+	fence(c->fence);
+	c->y[i] = 1;
+}
+
+static void mp1(struct litmus_ctx *c, size_t i)
+{
+	c->r[0][i] = c->y[i];
+	fence(c->fence);
+	c->r[1][i] = c->x[i];
+}
+
+/* LB: r0 = x; y = 1 || r1 = y; x = 1 */
+static void lb0(struct litmus_ctx *c, size_t i)
+{
+	c->r[0][i] = c->x[i];
+	fence(c->fence);
+	c->y[i] = 1;
+}
+
+static void lb1(struct litmus_ctx *c, size_t i)
+{
+	c->r[1][i] = c->y[i];
+	fence(c->fence);
+	c->x[i] = 1;
+}
+
+/* IRIW: x = 1 || y = 1 || r0 = x; r1 = y || r2 = y; r3 = x */
+static void iriw0(struct litmus_ctx *c, size_t i)
+{
+	c->x[i] = 1;
+}
+
+static void iriw1(struct litmus_ctx *c, size_t i)
+{
+	c->y[i] = 1;
+}
+
+static void iriw2(struct litmus_ctx *c, size_t i)
+{
+	c->r[0][i] = c->x[i];
+	fence(c->fence);
+	c->r[1][i] = c->y[i];
+}
+
+static void iriw3(struct litmus_ctx *c, size_t i)
+{
+	c->r[2][i] = c->y[i];
+	fence(c->fence);
+	c->r[3][i] = c->x[i];
+}
+
+/* 2+2W: x = 1; y = 2 || y = 1; x = 2, final x and y */
+static void w2_0(struct litmus_ctx *c, size_t i)
+{
+	c->x[i] = 1;
+	fence(c->fence);
+	c->y[i] = 2;
+}
+
+static void w2_1(struct litmus_ctx *c, size_t i)
+{
+	c->y[i] = 1;
+	fence(c->fence);
+	c->x[i] = 2;
+}
+
+static const struct litmus tests[] = {
+	{ "SB", 2, 2, { sb0, sb1 }, false, { 0, 0 },
+	  "r0=y r1=x, both stores passed by the loads" },
+	{ "MP", 2, 2, { mp0, mp1 }, false, { 1, 0 },
+	  "r0=y r1=x, flag seen before the data" },
+	{ "LB", 2, 2, { lb0, lb1 }, false, { 1, 1 },
+	  "r0=x r1=y, loads see the later stores" },
+	{ "IRIW", 4, 4, { iriw0, iriw1, iriw2, iriw3 }, false, { 1, 0, 1, 0 },
+	  "r0=x r1=y r2=y r3=x, readers disagree on the order of stores" },
+	{ "2+2W", 2, 2, { w2_0, w2_1 }, true, { 1, 1 },
+	  "final x y, both first stores last" },
+};
+
+#define NR_TESTS	(sizeof(tests) / sizeof(tests[0]))
+
+static const struct litmus *test;
+static struct litmus_ctx ctx;
+static struct litmus_thread threads[MAX_THREADS];
+static struct central_barrier trial_barrier;
+static uint64_t histogram[MAX_OUTCOMES];
+static size_t nr_trials = 1000000;
+/* taken by thread 0 */
+static uint64_t t_start, t_end;
+
+static int cpu_list[CPU_SETSIZE];
+static int nr_cpus;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void tally(size_t n)
+{
+	size_t i;
+	int k;
+
+	for (i = 0; i < n; i++) {
+		int idx = 0;
+
+		for (k = test->nr_regs - 1; k >= 0; k--) {
+			int v;
+
+			if (test->final)
+				v = k == 0 ? ctx.x[i] : ctx.y[i];
+			else
+				v = ctx.r[k][i];
+			idx = idx * 3 + v;
+		}
+		histogram[idx]++;
+	}
+
+	memset((void *)ctx.x, 0, BATCH * sizeof(*ctx.x));
+	memset((void *)ctx.y, 0, BATCH * sizeof(*ctx.y));
+}
+
+static void *litmus_thread_fn(void *arg)
+{
+	struct litmus_thread *t = arg;
+	void (*fn)(struct litmus_ctx *c, size_t i) = test->thread[t->id];
+	size_t done, i, n;
+
+	/*
+	 * Line everyone up before starting the clock, the barrier of the
+	 * first trial keeps the others from running ahead of it.
+	 */
+	central_barrier_wait(&trial_barrier, t->id);
+	if (t->id == 0)
+		t_start = now_ns();
+
+	for (done = 0; done < nr_trials; done += n) {
+		n = nr_trials - done < BATCH ? nr_trials - done : BATCH;
+
+		for (i = 0; i < n; i++) {
+			central_barrier_wait(&trial_barrier, t->id);
+			fn(&ctx, i);
+		}
+
+		/* everyone is done with the batch, the first one counts it */
+		central_barrier_wait(&trial_barrier, t->id);
+		if (t->id == 0)
+			tally(n);
+		central_barrier_wait(&trial_barrier, t->id);
+	}
+
+	/* the last batch is counted and everyone is past it */
+	if (t->id == 0)
+		t_end = now_ns();
+
+	return NULL;
+}
+
+static int run_test(const struct litmus *l, enum fence_kind kind,
+		    double *rate)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int i, started;
+
+	test = l;
+	ctx.fence = kind;
+	memset(histogram, 0, sizeof(histogram));
+	memset((void *)ctx.x, 0, BATCH * sizeof(*ctx.x));
+	memset((void *)ctx.y, 0, BATCH * sizeof(*ctx.y));
+	if (central_barrier_init(&trial_barrier, l->nr_threads))
+		return -1;
+
+	pthread_attr_init(&attr);
+
+	for (started = 0; started < l->nr_threads; started++) {
+		struct litmus_thread *t = &threads[started];
+
+		t->id = started;
+		t->cpu = cpu_list[started % nr_cpus];
+
+		CPU_ZERO(&cpus);
+		CPU_SET(t->cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+		if (pthread_create(&t->tid, &attr, litmus_thread_fn, t)) {
+			fprintf(stderr, "Failed create thread %d\n", started);
+			break;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	if (started != l->nr_threads) {
+		/* the started ones would wait for the rest forever */
+		exit(-1);
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i].tid, NULL);
+
+	central_barrier_destroy(&trial_barrier);
+
+	*rate = (double)nr_trials * NSEC_IN_SEC / (t_end - t_start + 1);
+	return 0;
+}
+
+static void print_histogram(const struct litmus *l)
+{
+	int relaxed = 0;
+	int idx, k;
+
+	for (k = l->nr_regs - 1; k >= 0; k--)
+		relaxed = relaxed * 3 + l->relaxed[k];
+
+	for (idx = 0; idx < MAX_OUTCOMES; idx++) {
+		int v = idx;
+
+		if (!histogram[idx])
+			continue;
+
+		printf("    %c", idx == relaxed ? '*' : ' ');
+		for (k = 0; k < l->nr_regs; k++) {
+			printf(" %d", v % 3);
+			v /= 3;
+		}
+		printf("  %12llu\n", (unsigned long long)histogram[idx]);
+	}
+
+	if (!histogram[relaxed])
+		printf("    * relaxed outcome not observed\n");
+}
+
+static int get_cpus(void)
+{
+	cpu_set_t cpus;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus))
+		return -1;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus))
+			cpu_list[nr_cpus++] = cpu;
+	}
+
+	return nr_cpus ? 0 : -1;
+}
+
+static void usage(const char *prog)
+{
+	size_t i;
+
+	printf("usage: %s [-n trials] [-t test] [-f fence]\n", prog);
+	printf("  tests:");
+	for (i = 0; i < NR_TESTS; i++)
+		printf(" %s", tests[i].name);
+	printf("\n  fences:");
+	for (i = 0; i < NR_FENCES; i++)
+		printf(" %s", fence_names[i]);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *only_test = NULL, *only_fence = NULL;
+	size_t t;
+	int f, k, opt;
+
+	while ((opt = getopt(argc, argv, "n:t:f:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_trials = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			only_test = optarg;
+			break;
+		case 'f':
+			only_fence = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (get_cpus()) {
+		fprintf(stderr, "Failed to get the CPUs\n");
+		return -1;
+	}
+
+	ctx.x = calloc(BATCH, sizeof(*ctx.x));
+	ctx.y = calloc(BATCH, sizeof(*ctx.y));
+	if (!ctx.x || !ctx.y) {
+		fprintf(stderr, "Failed to allocate the trials\n");
+		return -1;
+	}
+
+	for (k = 0; k < MAX_REGS; k++) {
+		ctx.r[k] = calloc(BATCH, sizeof(*ctx.r[k]));
+		if (!ctx.r[k]) {
+			fprintf(stderr, "Failed to allocate the trials\n");
+			return -1;
+		}
+	}
+
+	printf("%zu trials per run, %d CPUs\n", nr_trials, nr_cpus);
+
+	for (t = 0; t < NR_TESTS; t++) {
+		if (only_test && strcasecmp(only_test, tests[t].name))
+			continue;
+
+		printf("\n%s: %s\n", tests[t].name, tests[t].desc);
+
+		for (f = 0; f < NR_FENCES; f++) {
+			double rate;
+
+			if (only_fence && strcmp(only_fence, fence_names[f]))
+				continue;
+
+			if (run_test(&tests[t], f, &rate))
+				return -1;
+
+			printf("  %-12s %12.0f trials/s\n", fence_names[f], rate);
+			print_histogram(&tests[t]);
+		}
+	}
+
+	return 0;
+}
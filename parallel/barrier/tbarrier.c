@@ -0,0 +1,226 @@
+/*
+ * tbarrier.c - centralised, combining tree and dissemination barriers
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "tbarrier.h"
+
+#define SPIN_LIMIT	4096
+
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+static inline void spin(unsigned int *spins)
+{
+	if (++*spins < SPIN_LIMIT) {
+		cpu_relax();
+	} else {
+		*spins = 0;
+		sched_yield();
+	}
+}
+
+static inline void wait_for(_Atomic int *v, int val)
+{
+	unsigned int spins = 0;
+
+	while (atomic_load_explicit(v, memory_order_acquire) != val)
+		spin(&spins);
+}
+
+static struct tb_local *alloc_local(int nr)
+{
+	struct tb_local *local;
+
+	local = aligned_alloc(TB_CACHE_LINE, nr * sizeof(*local));
+	if (local)
+		memset(local, 0, nr * sizeof(*local));
+
+	return local;
+}
+
+int central_barrier_init(struct central_barrier *b, int nr)
+{
+	if (nr < 1)
+		return -1;
+
+	b->local = alloc_local(nr);
+	if (!b->local)
+		return -1;
+
+	atomic_init(&b->count, nr);
+	atomic_init(&b->sense, 0);
+	b->nr = nr;
+	return 0;
+}
+
+void central_barrier_destroy(struct central_barrier *b)
+{
+	free(b->local);
+	b->local = NULL;
+}
+
+void central_barrier_wait(struct central_barrier *b, int id)
+{
+	int sense = b->local[id].sense = !b->local[id].sense;
+
+	if (atomic_fetch_sub_explicit(&b->count, 1,
+				      memory_order_acq_rel) == 1) {
+		/* the last one: reset for the next episode and release */
+		atomic_store_explicit(&b->count, b->nr, memory_order_relaxed);
+		atomic_store_explicit(&b->sense, sense, memory_order_release);
+		return;
+	}
+
+	wait_for(&b->sense, sense);
+}
+
+int tree_barrier_init(struct tree_barrier *b, int nr)
+{
+	int level_nr, level_first, nr_nodes = 0;
+	int n, i;
+
+	if (nr < 1)
+		return -1;
+
+	/* count the nodes level by level up to the single root */
+	for (n = nr; ; n = (n + TB_TREE_ARITY - 1) / TB_TREE_ARITY) {
+		int nodes = (n + TB_TREE_ARITY - 1) / TB_TREE_ARITY;
+
+		nr_nodes += nodes;
+		if (nodes == 1)
+			break;
+	}
+
+	b->nodes = aligned_alloc(TB_CACHE_LINE,
+				 nr_nodes * sizeof(*b->nodes));
+	b->local = alloc_local(nr);
+	if (!b->nodes || !b->local) {
+		free(b->nodes);
+		free(b->local);
+		return -1;
+	}
+
+	/* leaves first, the parent of node i of a level is i / arity above */
+	level_first = 0;
+	for (n = nr; ; n = level_nr) {
+		level_nr = (n + TB_TREE_ARITY - 1) / TB_TREE_ARITY;
+
+		for (i = 0; i < level_nr; i++) {
+			struct tree_node *node = &b->nodes[level_first + i];
+			int children = n - i * TB_TREE_ARITY;
+
+			node->nr = children < TB_TREE_ARITY ?
+				   children : TB_TREE_ARITY;
+			atomic_init(&node->count, node->nr);
+			node->parent = level_nr == 1 ? NULL :
+				&b->nodes[level_first + level_nr +
+					  i / TB_TREE_ARITY];
+		}
+
+		if (level_nr == 1)
+			break;
+		level_first += level_nr;
+	}
+
+	atomic_init(&b->sense, 0);
+	b->nr = nr;
+	return 0;
+}
+
+void tree_barrier_destroy(struct tree_barrier *b)
+{
+	free(b->nodes);
+	free(b->local);
+	b->nodes = NULL;
+	b->local = NULL;
+}
+
+void tree_barrier_wait(struct tree_barrier *b, int id)
+{
+	int sense = b->local[id].sense = !b->local[id].sense;
+	struct tree_node *node = &b->nodes[id / TB_TREE_ARITY];
+
+	for (;;) {
+		if (atomic_fetch_sub_explicit(&node->count, 1,
+					      memory_order_acq_rel) != 1)
+			break;
+
+		/* the last one at this node, reset it and go up */
+		atomic_store_explicit(&node->count, node->nr,
+				      memory_order_relaxed);
+
+		if (!node->parent) {
+			atomic_store_explicit(&b->sense, sense,
+					      memory_order_release);
+			return;
+		}
+		node = node->parent;
+	}
+
+	wait_for(&b->sense, sense);
+}
+
+int dissemination_barrier_init(struct dissemination_barrier *b, int nr)
+{
+	int i;
+
+	if (nr < 1)
+		return -1;
+
+	for (b->rounds = 0; (1 << b->rounds) < nr; b->rounds++)
+		;
+
+	if (b->rounds > TB_MAX_ROUNDS)
+		return -1;
+
+	b->flags = aligned_alloc(TB_CACHE_LINE, nr * sizeof(*b->flags));
+	b->local = alloc_local(nr);
+	if (!b->flags || !b->local) {
+		free(b->flags);
+		free(b->local);
+		return -1;
+	}
+
+	memset(b->flags, 0, nr * sizeof(*b->flags));
+	/* the first episode waits for the flags to become 1 */
+	for (i = 0; i < nr; i++)
+		b->local[i].sense = 1;
+
+	b->nr = nr;
+	return 0;
+}
+
+void dissemination_barrier_destroy(struct dissemination_barrier *b)
+{
+	free(b->flags);
+	free(b->local);
+	b->flags = NULL;
+	b->local = NULL;
+}
+
+/*
+ * The flags alternate between two sets (parity), so a fast thread which
+ * is already in the next episode can't overwrite a flag the slow partner
+ * hasn't seen yet. The sense flips every second episode, when the parity
+ * comes back to the first set.
+ */
+void dissemination_barrier_wait(struct dissemination_barrier *b, int id)
+{
+	struct tb_local *l = &b->local[id];
+	int r;
+
+	for (r = 0; r < b->rounds; r++) {
+		int partner = (id + (1 << r)) % b->nr;
+
+		atomic_store_explicit(&b->flags[partner].flag[l->parity][r],
+				      l->sense, memory_order_release);
+		wait_for(&b->flags[id].flag[l->parity][r], l->sense);
+	}
+
+	if (l->parity)
+		l->sense = !l->sense;
+	l->parity = !l->parity;
+}
@@ -0,0 +1,78 @@
+#ifndef __TBARRIER_H
+#define __TBARRIER_H
+
+/*
+ * Reusable spinning barriers for a fixed number of threads, each thread
+ * passes its id (0 .. nr - 1) to the wait. The waiters spin for a while
+ * and then yield, so the barriers still make progress when there are more
+ * threads than CPUs.
+ */
+
+#include <stdatomic.h>
+
+#define TB_CACHE_LINE	64
+#define TB_MAX_ROUNDS	16
+/* fan-in of the combining tree */
+#define TB_TREE_ARITY	4
+
+struct tb_local {
+	int sense;
+	int parity;
+} __attribute__((aligned(TB_CACHE_LINE)));
+
+/* all the threads count down one counter, the last one flips the sense */
+struct central_barrier {
+	_Atomic int count __attribute__((aligned(TB_CACHE_LINE)));
+	_Atomic int sense __attribute__((aligned(TB_CACHE_LINE)));
+	int nr;
+	struct tb_local *local;
+};
+
+struct tree_node {
+	_Atomic int count;
+	int nr;
+	struct tree_node *parent;
+} __attribute__((aligned(TB_CACHE_LINE)));
+
+/*
+ * The threads count down the leaf nodes in groups of TB_TREE_ARITY, the
+ * last one at a node goes up to count down its parent, the last one at
+ * the root flips the sense. No counter sees more than TB_TREE_ARITY
+ * contending threads.
+ */
+struct tree_barrier {
+	_Atomic int sense __attribute__((aligned(TB_CACHE_LINE)));
+	int nr;
+	struct tree_node *nodes;
+	struct tb_local *local;
+};
+
+struct tb_flags {
+	_Atomic int flag[2][TB_MAX_ROUNDS];
+} __attribute__((aligned(TB_CACHE_LINE)));
+
+/*
+ * In round r thread i signals thread (i + 2^r) % nr and waits for the
+ * signal from (i - 2^r) % nr, after log2(nr) rounds everyone has heard
+ * from everyone. There is no shared counter at all.
+ */
+struct dissemination_barrier {
+	int nr;
+	int rounds;
+	struct tb_flags *flags;
+	struct tb_local *local;
+};
+
+int central_barrier_init(struct central_barrier *b, int nr);
+void central_barrier_destroy(struct central_barrier *b);
+void central_barrier_wait(struct central_barrier *b, int id);
+
+int tree_barrier_init(struct tree_barrier *b, int nr);
+void tree_barrier_destroy(struct tree_barrier *b);
+void tree_barrier_wait(struct tree_barrier *b, int id);
+
+int dissemination_barrier_init(struct dissemination_barrier *b, int nr);
+void dissemination_barrier_destroy(struct dissemination_barrier *b);
+void dissemination_barrier_wait(struct dissemination_barrier *b, int id);
+
+#endif /* __TBARRIER_H */
@@ -0,0 +1,407 @@
+/*
+ * pool_bench.c - fine-grained task throughput of the work-stealing pool
+ * against a pool with one mutex protected global queue
+ *
+ * fib(n) spawns fib(n - 1), computes fib(n - 2) itself and waits, so every
+ * call with n >= 2 is a task of a few ns of work and the scheduler cost is
+ * all that is measured. The parallel-for row times a pass over an array.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "tpool.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+#define SPIN_LIMIT	1024
+
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+/*
+ * The same spawn/wait interface on one global queue. It is LIFO: a waiter
+ * popping the oldest task (the biggest subtree) recurses without a bound.
+ */
+struct mq_pool {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct tpool_task *head;
+	pthread_t *tids;
+	int nr_workers;
+	bool stop;
+};
+
+struct fib_arg {
+	int n;
+	uint64_t res;
+};
+
+static struct tpool pool;
+static struct mq_pool mq;
+static __thread bool mq_worker_thread;
+static float *array;
+static size_t array_size = 1 << 24;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static inline void backoff(unsigned int *spins)
+{
+	if (++*spins < SPIN_LIMIT) {
+		cpu_relax();
+	} else {
+		*spins = 0;
+		sched_yield();
+	}
+}
+
+static struct tpool_task *mq_pop(struct mq_pool *p)
+{
+	struct tpool_task *task = p->head;
+
+	if (task)
+		p->head = task->next;
+
+	return task;
+}
+
+static void mq_run(struct tpool_task *task)
+{
+	struct tpool_group *g = task->group;
+
+	task->fn(task->arg);
+	atomic_fetch_sub_explicit(&g->pending, 1, memory_order_release);
+}
+
+static void *mq_worker(void *arg)
+{
+	struct mq_pool *p = arg;
+
+	mq_worker_thread = true;
+
+	for (;;) {
+		struct tpool_task *task;
+
+		pthread_mutex_lock(&p->lock);
+		while (!p->head && !p->stop)
+			pthread_cond_wait(&p->cond, &p->lock);
+		if (p->stop) {
+			pthread_mutex_unlock(&p->lock);
+			return NULL;
+		}
+		task = mq_pop(p);
+		pthread_mutex_unlock(&p->lock);
+
+		mq_run(task);
+	}
+}
+
+static void mq_spawn(struct mq_pool *p, struct tpool_group *g,
+		     struct tpool_task *task, tpool_fn fn, void *arg)
+{
+	task->fn = fn;
+	task->arg = arg;
+	task->group = g;
+
+	atomic_fetch_add_explicit(&g->pending, 1, memory_order_relaxed);
+
+	pthread_mutex_lock(&p->lock);
+	task->next = p->head;
+	p->head = task;
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/*
+ * Like tpool_wait(): a worker runs queued tasks until the group is done, an
+ * outside thread only waits, so both pools run the tasks on nr workers.
+ */
+static void mq_wait(struct mq_pool *p, struct tpool_group *g)
+{
+	unsigned int spins = 0;
+
+	if (!mq_worker_thread) {
+		while (atomic_load_explicit(&g->pending, memory_order_acquire))
+			backoff(&spins);
+		return;
+	}
+
+	while (atomic_load_explicit(&g->pending, memory_order_acquire)) {
+		struct tpool_task *task;
+
+		pthread_mutex_lock(&p->lock);
+		task = mq_pop(p);
+		pthread_mutex_unlock(&p->lock);
+
+		if (task) {
+			mq_run(task);
+			spins = 0;
+		} else {
+			backoff(&spins);
+		}
+	}
+}
+
+static int mq_init(struct mq_pool *p, int nr)
+{
+	int i;
+
+	memset(p, 0, sizeof(*p));
+	p->tids = calloc(nr, sizeof(*p->tids));
+	if (!p->tids)
+		return -1;
+
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&p->tids[i], NULL, mq_worker, p))
+			break;
+	}
+	p->nr_workers = i;
+
+	return i == nr ? 0 : -1;
+}
+
+static void mq_destroy(struct mq_pool *p)
+{
+	int i;
+
+	pthread_mutex_lock(&p->lock);
+	p->stop = true;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->lock);
+
+	for (i = 0; i < p->nr_workers; i++)
+		pthread_join(p->tids[i], NULL);
+
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->cond);
+	free(p->tids);
+}
+
+static void fib_steal(void *arg)
+{
+	struct fib_arg *a = arg;
+	struct fib_arg x, y;
+	struct tpool_group g;
+	struct tpool_task task;
+
+	if (a->n < 2) {
+		a->res = a->n;
+		return;
+	}
+
+	x.n = a->n - 1;
+	y.n = a->n - 2;
+
+	tpool_group_init(&g);
+	tpool_spawn(&pool, &g, &task, fib_steal, &x);
+	fib_steal(&y);
+	tpool_wait(&pool, &g);
+
+	a->res = x.res + y.res;
+}
+
+static void fib_mq(void *arg)
+{
+	struct fib_arg *a = arg;
+	struct fib_arg x, y;
+	struct tpool_group g;
+	struct tpool_task task;
+
+	if (a->n < 2) {
+		a->res = a->n;
+		return;
+	}
+
+	x.n = a->n - 1;
+	y.n = a->n - 2;
+
+	tpool_group_init(&g);
+	mq_spawn(&mq, &g, &task, fib_mq, &x);
+	fib_mq(&y);
+	mq_wait(&mq, &g);
+
+	a->res = x.res + y.res;
+}
+
+static uint64_t fib_iter(int n)
+{
+	uint64_t a = 0, b = 1, t;
+
+	while (n--) {
+		t = a + b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* Mtasks/s of fib(n) submitted from the main thread, -1 on failure */
+static double run_fib(bool steal, int n)
+{
+	struct fib_arg root = { .n = n };
+	struct tpool_group g;
+	struct tpool_task task;
+	uint64_t t0, t1;
+
+	tpool_group_init(&g);
+
+	t0 = now_ns();
+	if (steal) {
+		tpool_spawn(&pool, &g, &task, fib_steal, &root);
+		tpool_wait(&pool, &g);
+	} else {
+		mq_spawn(&mq, &g, &task, fib_mq, &root);
+		mq_wait(&mq, &g);
+	}
+	t1 = now_ns();
+
+	if (root.res != fib_iter(n)) {
+		fprintf(stderr, "Wrong fib(%d): %lu\n", n, root.res);
+		return -1;
+	}
+
+	/* the spawns: calls with n >= 2, F(n + 1) - 1 of them */
+	return (double)(fib_iter(n + 1) - 1) * 1000 / (t1 - t0 + 1);
+}
+
+static void scale_range(size_t lo, size_t hi, void *arg)
+{
+	float k = *(float *)arg;
+	size_t i;
+
+	for (i = lo; i < hi; i++)
+		array[i] = array[i] * k + 1.0f;
+}
+
+/* ms of one parallel-for pass over the array */
+static double run_pfor(void)
+{
+	float k = 0.5f;
+	uint64_t t0, t1;
+
+	t0 = now_ns();
+	tpool_parallel_for(&pool, 0, array_size, 0, scale_range, &k);
+	t1 = now_ns();
+
+	return (double)(t1 - t0) / 1000000;
+}
+
+static bool check_array(void)
+{
+	size_t i;
+
+	/* x = 0 becomes 0 * 0.5 + 1 = 1 after one pass */
+	for (i = 0; i < array_size; i++) {
+		if (array[i] != 1.0f)
+			return false;
+	}
+
+	return true;
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-t max threads] [-n fib n] [-s parallel-for array size]\n",
+	       prog);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = 0, fib_n = 27;
+	int nr, opt;
+
+	while ((opt = getopt(argc, argv, "t:n:s:h")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'n':
+			fib_n = atoi(optarg);
+			break;
+		case 's':
+			array_size = strtoul(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (max_threads <= 0)
+		max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (fib_n < 2 || fib_n > 60 || !array_size) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	array = malloc(array_size * sizeof(*array));
+	if (!array) {
+		fprintf(stderr, "Failed to allocate the array\n");
+		return -1;
+	}
+
+	printf("fib(%d): %lu tasks, parallel-for over %zu floats\n", fib_n,
+	       fib_iter(fib_n + 1) - 1, array_size);
+	printf("%-8s %12s %12s %12s\n", "threads", "steal", "mutex",
+	       "pfor");
+	printf("%-8s %12s %12s %12s\n", "", "Mtasks/s", "Mtasks/s", "ms");
+
+	for (nr = 1; ; nr *= 2) {
+		double r[3];
+
+		if (nr > max_threads)
+			nr = max_threads;
+
+		if (tpool_init(&pool, nr)) {
+			fprintf(stderr, "Failed to start %d workers\n", nr);
+			return -1;
+		}
+		r[0] = run_fib(true, fib_n);
+
+		memset(array, 0, array_size * sizeof(*array));
+		r[2] = run_pfor();
+		tpool_destroy(&pool);
+
+		if (r[0] < 0)
+			return -1;
+		if (!check_array()) {
+			fprintf(stderr, "Wrong parallel-for result\n");
+			return -1;
+		}
+
+		if (mq_init(&mq, nr)) {
+			fprintf(stderr, "Failed to start %d workers\n", nr);
+			mq_destroy(&mq);
+			return -1;
+		}
+		r[1] = run_fib(false, fib_n);
+		mq_destroy(&mq);
+
+		if (r[1] < 0)
+			return -1;
+
+		printf("%-8d %12.2f %12.2f %12.2f\n", nr, r[0], r[1], r[2]);
+
+		if (nr == max_threads)
+			break;
+	}
+
+	free(array);
+	return 0;
+}
@@ -0,0 +1,457 @@
+/*
+ * tpool.c - work-stealing thread pool
+ *
+ * The deque is the Chase-Lev one with the C11 orderings from Le et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models", on a fixed
+ * size buffer.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "tpool.h"
+
+/* idle rounds before yielding and then before going to sleep */
+#define SPIN_LIMIT	1024
+#define YIELD_LIMIT	64
+
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+static __thread struct tp_worker *tp_self;
+
+static inline void backoff(unsigned int *spins)
+{
+	if (++*spins < SPIN_LIMIT) {
+		cpu_relax();
+	} else {
+		*spins = 0;
+		sched_yield();
+	}
+}
+
+/* owner only */
+static bool deque_push(struct tp_deque *dq, struct tpool_task *task)
+{
+	long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+
+	if (b - t >= TP_DEQUE_SIZE)
+		return false;
+
+	atomic_store_explicit(&dq->tasks[b % TP_DEQUE_SIZE], task,
+			      memory_order_relaxed);
+	atomic_store_explicit(&dq->bottom, b + 1, memory_order_release);
+	return true;
+}
+
+/* owner only, takes the most recent task */
+static struct tpool_task *deque_take(struct tp_deque *dq)
+{
+	long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+	struct tpool_task *task = NULL;
+	long t;
+
+	atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+	if (t <= b) {
+		task = atomic_load_explicit(&dq->tasks[b % TP_DEQUE_SIZE],
+					    memory_order_relaxed);
+		if (t == b) {
+			/* the last one, race the thieves for it */
+			if (!atomic_compare_exchange_strong_explicit(&dq->top,
+					&t, t + 1, memory_order_seq_cst,
+					memory_order_relaxed))
+				task = NULL;
+			atomic_store_explicit(&dq->bottom, b + 1,
+					      memory_order_relaxed);
+		}
+	} else {
+		atomic_store_explicit(&dq->bottom, b + 1,
+				      memory_order_relaxed);
+	}
+
+	return task;
+}
+
+/* any thread, takes the oldest task, NULL if empty or lost the race */
+static struct tpool_task *deque_steal(struct tp_deque *dq)
+{
+	long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+	struct tpool_task *task;
+	long b;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+	if (t >= b)
+		return NULL;
+
+	task = atomic_load_explicit(&dq->tasks[t % TP_DEQUE_SIZE],
+				    memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+						     memory_order_seq_cst,
+						     memory_order_relaxed))
+		return NULL;
+
+	return task;
+}
+
+static bool deque_empty(struct tp_deque *dq)
+{
+	return atomic_load(&dq->top) >= atomic_load(&dq->bottom);
+}
+
+static void inject_push(struct tpool *pool, struct tpool_task *task)
+{
+	pthread_mutex_lock(&pool->inject_lock);
+
+	if (pool->inject_tail)
+		pool->inject_tail->next = task;
+	else
+		pool->inject_head = task;
+	pool->inject_tail = task;
+	atomic_store(&pool->inject_empty, false);
+
+	pthread_mutex_unlock(&pool->inject_lock);
+}
+
+static struct tpool_task *inject_pop(struct tpool *pool)
+{
+	struct tpool_task *task;
+
+	if (atomic_load_explicit(&pool->inject_empty, memory_order_relaxed))
+		return NULL;
+
+	pthread_mutex_lock(&pool->inject_lock);
+
+	task = pool->inject_head;
+	if (task) {
+		pool->inject_head = task->next;
+		if (!pool->inject_head) {
+			pool->inject_tail = NULL;
+			atomic_store(&pool->inject_empty, true);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->inject_lock);
+	return task;
+}
+
+static bool has_work(struct tpool *pool)
+{
+	int i;
+
+	if (!atomic_load(&pool->inject_empty))
+		return true;
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		if (!deque_empty(&pool->workers[i].deque))
+			return true;
+	}
+
+	return false;
+}
+
+static void wake_one(struct tpool *pool)
+{
+	/* pairs with the increment of nr_sleeping in worker_sleep() */
+	atomic_thread_fence(memory_order_seq_cst);
+	if (!atomic_load_explicit(&pool->nr_sleeping, memory_order_relaxed))
+		return;
+
+	pthread_mutex_lock(&pool->sleep_lock);
+	pthread_cond_signal(&pool->sleep_cond);
+	pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+static void worker_sleep(struct tpool *pool)
+{
+	pthread_mutex_lock(&pool->sleep_lock);
+
+	atomic_fetch_add(&pool->nr_sleeping, 1);
+	if (!atomic_load(&pool->stop) && !has_work(pool))
+		pthread_cond_wait(&pool->sleep_cond, &pool->sleep_lock);
+	atomic_fetch_sub(&pool->nr_sleeping, 1);
+
+	pthread_mutex_unlock(&pool->sleep_lock);
+}
+
+/* self is NULL for the threads outside of the pool */
+static struct tpool_task *find_task(struct tpool *pool, struct tp_worker *self)
+{
+	struct tpool_task *task;
+	unsigned int victim;
+	int i;
+
+	if (self) {
+		task = deque_take(&self->deque);
+		if (task)
+			return task;
+	}
+
+	task = inject_pop(pool);
+	if (task)
+		return task;
+
+	if (self) {
+		self->seed = self->seed * 1103515245 + 12345;
+		victim = (self->seed >> 16) % pool->nr_workers;
+	} else {
+		victim = 0;
+	}
+
+	for (i = 0; i < pool->nr_workers; i++) {
+		struct tp_worker *w = &pool->workers[victim];
+
+		if (w != self) {
+			task = deque_steal(&w->deque);
+			if (task)
+				return task;
+		}
+
+		if (++victim == (unsigned int)pool->nr_workers)
+			victim = 0;
+	}
+
+	return NULL;
+}
+
+static void run_task(struct tpool_task *task)
+{
+	/* the task may be gone once the group drops to zero */
+	struct tpool_group *g = task->group;
+
+	task->fn(task->arg);
+	atomic_fetch_sub_explicit(&g->pending, 1, memory_order_release);
+}
+
+static void *worker_fn(void *arg)
+{
+	struct tp_worker *self = arg;
+	struct tpool *pool = self->pool;
+	unsigned int idle = 0;
+
+	tp_self = self;
+
+	while (!atomic_load_explicit(&pool->stop, memory_order_relaxed)) {
+		struct tpool_task *task = find_task(pool, self);
+
+		if (task) {
+			run_task(task);
+			idle = 0;
+		} else if (++idle < SPIN_LIMIT) {
+			cpu_relax();
+		} else if (idle < SPIN_LIMIT + YIELD_LIMIT) {
+			sched_yield();
+		} else {
+			worker_sleep(pool);
+			idle = 0;
+		}
+	}
+
+	return NULL;
+}
+
+void tpool_spawn(struct tpool *pool, struct tpool_group *g,
+		 struct tpool_task *task, tpool_fn fn, void *arg)
+{
+	struct tp_worker *self = tp_self;
+
+	task->fn = fn;
+	task->arg = arg;
+	task->group = g;
+	task->next = NULL;
+
+	atomic_fetch_add_explicit(&g->pending, 1, memory_order_relaxed);
+
+	if (self && self->pool == pool) {
+		if (!deque_push(&self->deque, task)) {
+			run_task(task);
+			return;
+		}
+	} else {
+		inject_push(pool, task);
+	}
+
+	wake_one(pool);
+}
+
+void tpool_wait(struct tpool *pool, struct tpool_group *g)
+{
+	struct tp_worker *self = tp_self;
+	unsigned int spins = 0;
+
+	/*
+	 * Outside threads only wait: whatever they ran would spawn through
+	 * the injection queue.
+	 */
+	if (!self || self->pool != pool) {
+		while (atomic_load_explicit(&g->pending, memory_order_acquire))
+			backoff(&spins);
+		return;
+	}
+
+	while (atomic_load_explicit(&g->pending, memory_order_acquire)) {
+		struct tpool_task *task = find_task(pool, self);
+
+		if (task) {
+			run_task(task);
+			spins = 0;
+		} else {
+			backoff(&spins);
+		}
+	}
+}
+
+struct pfor_ctx {
+	struct tpool *pool;
+	size_t grain;
+	void (*fn)(size_t lo, size_t hi, void *arg);
+	void *arg;
+};
+
+struct pfor_range {
+	const struct pfor_ctx *ctx;
+	size_t lo;
+	size_t hi;
+};
+
+static void pfor_split(const struct pfor_ctx *ctx, size_t lo, size_t hi);
+
+static void pfor_task(void *arg)
+{
+	struct pfor_range *r = arg;
+
+	pfor_split(r->ctx, r->lo, r->hi);
+}
+
+/* spawn the upper half, recurse into the lower one */
+static void pfor_split(const struct pfor_ctx *ctx, size_t lo, size_t hi)
+{
+	struct pfor_range upper;
+	struct tpool_group g;
+	struct tpool_task task;
+	size_t mid;
+
+	if (hi - lo <= ctx->grain) {
+		ctx->fn(lo, hi, ctx->arg);
+		return;
+	}
+
+	mid = lo + (hi - lo) / 2;
+	upper = (struct pfor_range) { .ctx = ctx, .lo = mid, .hi = hi };
+
+	tpool_group_init(&g);
+	tpool_spawn(ctx->pool, &g, &task, pfor_task, &upper);
+	pfor_split(ctx, lo, mid);
+	tpool_wait(ctx->pool, &g);
+}
+
+void tpool_parallel_for(struct tpool *pool, size_t begin, size_t end,
+			size_t grain,
+			void (*fn)(size_t lo, size_t hi, void *arg),
+			void *arg)
+{
+	struct pfor_ctx ctx = {
+		.pool = pool, .grain = grain, .fn = fn, .arg = arg,
+	};
+
+	if (begin >= end)
+		return;
+
+	if (!ctx.grain) {
+		ctx.grain = (end - begin) / (pool->nr_workers * 8);
+		if (!ctx.grain)
+			ctx.grain = 1;
+	}
+
+	/* from outside of the pool hand the whole range over to a worker */
+	if (!tp_self || tp_self->pool != pool) {
+		struct pfor_range all = { .ctx = &ctx, .lo = begin, .hi = end };
+		struct tpool_group g;
+		struct tpool_task task;
+
+		tpool_group_init(&g);
+		tpool_spawn(pool, &g, &task, pfor_task, &all);
+		tpool_wait(pool, &g);
+		return;
+	}
+
+	pfor_split(&ctx, begin, end);
+}
+
+/* stop and join the first nr workers, then free the pool */
+static void stop_workers(struct tpool *pool, int nr)
+{
+	int i;
+
+	atomic_store(&pool->stop, true);
+
+	pthread_mutex_lock(&pool->sleep_lock);
+	pthread_cond_broadcast(&pool->sleep_cond);
+	pthread_mutex_unlock(&pool->sleep_lock);
+
+	for (i = 0; i < nr; i++)
+		pthread_join(pool->workers[i].tid, NULL);
+
+	pthread_mutex_destroy(&pool->inject_lock);
+	pthread_mutex_destroy(&pool->sleep_lock);
+	pthread_cond_destroy(&pool->sleep_cond);
+	free(pool->workers);
+	pool->workers = NULL;
+}
+
+int tpool_init(struct tpool *pool, int nr_workers)
+{
+	int i;
+
+	if (nr_workers < 1)
+		return -1;
+
+	pool->workers = aligned_alloc(TP_CACHE_LINE,
+				      nr_workers * sizeof(*pool->workers));
+	if (!pool->workers)
+		return -1;
+	memset(pool->workers, 0, nr_workers * sizeof(*pool->workers));
+
+	pool->nr_workers = nr_workers;
+	pool->inject_head = NULL;
+	pool->inject_tail = NULL;
+	atomic_init(&pool->inject_empty, true);
+	atomic_init(&pool->nr_sleeping, 0);
+	atomic_init(&pool->stop, false);
+	pthread_mutex_init(&pool->inject_lock, NULL);
+	pthread_mutex_init(&pool->sleep_lock, NULL);
+	pthread_cond_init(&pool->sleep_cond, NULL);
+
+	for (i = 0; i < nr_workers; i++) {
+		struct tp_worker *w = &pool->workers[i];
+
+		atomic_init(&w->deque.top, 0);
+		atomic_init(&w->deque.bottom, 0);
+		w->pool = pool;
+		w->id = i;
+		w->seed = i + 1;
+	}
+
+	for (i = 0; i < nr_workers; i++) {
+		if (pthread_create(&pool->workers[i].tid, NULL, worker_fn,
+				   &pool->workers[i]))
+			break;
+	}
+
+	if (i < nr_workers) {
+		stop_workers(pool, i);
+		return -1;
+	}
+
+	return 0;
+}
+
+void tpool_destroy(struct tpool *pool)
+{
+	stop_workers(pool, pool->nr_workers);
+}
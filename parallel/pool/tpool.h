@@ -0,0 +1,101 @@
+#ifndef __TPOOL_H
+#define __TPOOL_H
+
+/*
+ * Fixed-size thread pool with per-worker Chase-Lev work-stealing deques.
+ *
+ * A task spawned by a worker goes to the bottom of the worker's own deque,
+ * the worker takes its tasks back LIFO and idle workers steal from the top.
+ * A task spawned by any other thread goes to a shared injection queue.
+ * Tasks live in the caller's memory (usually the stack of the spawning
+ * function) until the group they belong to is waited for, so spawning does
+ * not allocate. A worker waiting for a group runs other tasks meanwhile, so
+ * recursive spawn-and-wait never blocks a worker.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define TP_CACHE_LINE	64
+/* tasks a deque holds, spawns beyond it run inline */
+#define TP_DEQUE_SIZE	1024
+
+typedef void (*tpool_fn)(void *arg);
+
+struct tpool_group {
+	/* spawned tasks not finished yet */
+	atomic_size_t pending;
+};
+
+struct tpool_task {
+	tpool_fn fn;
+	void *arg;
+	struct tpool_group *group;
+	/* link in the injection queue */
+	struct tpool_task *next;
+};
+
+struct tp_deque {
+	atomic_long top __attribute__((aligned(TP_CACHE_LINE)));
+	atomic_long bottom __attribute__((aligned(TP_CACHE_LINE)));
+	struct tpool_task *_Atomic tasks[TP_DEQUE_SIZE];
+};
+
+struct tpool;
+
+struct tp_worker {
+	struct tp_deque deque;
+	struct tpool *pool;
+	pthread_t tid;
+	unsigned int seed;
+	int id;
+} __attribute__((aligned(TP_CACHE_LINE)));
+
+struct tpool {
+	struct tp_worker *workers;
+	int nr_workers;
+
+	/* tasks from non-worker threads, FIFO */
+	pthread_mutex_t inject_lock;
+	struct tpool_task *inject_head;
+	struct tpool_task *inject_tail;
+	atomic_bool inject_empty;
+
+	/* idle workers sleep here after spinning for a while */
+	pthread_mutex_t sleep_lock;
+	pthread_cond_t sleep_cond;
+	atomic_int nr_sleeping;
+	atomic_bool stop;
+};
+
+int tpool_init(struct tpool *pool, int nr_workers);
+void tpool_destroy(struct tpool *pool);
+
+static inline void tpool_group_init(struct tpool_group *g)
+{
+	atomic_init(&g->pending, 0);
+}
+
+/*
+ * Queue fn(arg) in the group, the task must stay valid until the group is
+ * waited for. Works from any thread, the workers included.
+ */
+void tpool_spawn(struct tpool *pool, struct tpool_group *g,
+		 struct tpool_task *task, tpool_fn fn, void *arg);
+
+/* return when all the tasks of the group are finished */
+void tpool_wait(struct tpool *pool, struct tpool_group *g);
+
+/*
+ * Call fn on disjoint subranges covering [begin, end) of at most grain
+ * items in parallel and return when all are done, grain 0 picks one
+ * giving about 8 subranges per worker.
+ */
+void tpool_parallel_for(struct tpool *pool, size_t begin, size_t end,
+			size_t grain,
+			void (*fn)(size_t lo, size_t hi, void *arg),
+			void *arg);
+
+#endif /* __TPOOL_H */
@@ -0,0 +1,134 @@
+#ifndef __MPMC_QUEUE_H
+#define __MPMC_QUEUE_H
+
+/*
+ * Bounded multi producer multi consumer queue of pointers (D. Vyukov).
+ *
+ * Every cell has a sequence number which tells whose turn it is: the cell
+ * at position pos is free for the producer of pos if seq == pos, and holds
+ * the value for the consumer of pos if seq == pos + 1. Producers and
+ * consumers claim positions with a CAS on their own counter, so they only
+ * contend with their own kind and never wait for each other's CAS.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#define MPMC_CACHE_LINE	64
+
+struct mpmc_cell {
+	_Atomic size_t seq;
+	void *data;
+};
+
+struct mpmc_queue {
+	struct mpmc_cell *cells __attribute__((aligned(MPMC_CACHE_LINE)));
+	size_t mask;
+
+	_Atomic size_t enqueue_pos __attribute__((aligned(MPMC_CACHE_LINE)));
+	_Atomic size_t dequeue_pos __attribute__((aligned(MPMC_CACHE_LINE)));
+};
+
+/* size must be a power of 2 */
+static inline int mpmc_queue_init(struct mpmc_queue *q, size_t size)
+{
+	size_t i;
+
+	if (size < 2 || (size & (size - 1)))
+		return -1;
+
+	q->cells = malloc(size * sizeof(*q->cells));
+	if (!q->cells)
+		return -1;
+
+	for (i = 0; i < size; i++)
+		atomic_init(&q->cells[i].seq, i);
+
+	q->mask = size - 1;
+	atomic_init(&q->enqueue_pos, 0);
+	atomic_init(&q->dequeue_pos, 0);
+	return 0;
+}
+
+static inline void mpmc_queue_free(struct mpmc_queue *q)
+{
+	free(q->cells);
+	q->cells = NULL;
+}
+
+/* returns false if the queue is full */
+static inline bool mpmc_push(struct mpmc_queue *q, void *v)
+{
+	size_t pos = atomic_load_explicit(&q->enqueue_pos,
+					  memory_order_relaxed);
+	struct mpmc_cell *cell;
+
+	for (;;) {
+		size_t seq;
+		intptr_t diff;
+
+		cell = &q->cells[pos & q->mask];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		diff = (intptr_t)seq - (intptr_t)pos;
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+					&q->enqueue_pos, &pos, pos + 1,
+					memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			/* the consumer of pos - size has not been here yet */
+			return false;
+		} else {
+			pos = atomic_load_explicit(&q->enqueue_pos,
+						   memory_order_relaxed);
+		}
+	}
+
+	cell->data = v;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	return true;
+}
+
+/* returns false if the queue is empty */
+static inline bool mpmc_pop(struct mpmc_queue *q, void **v)
+{
+	size_t pos = atomic_load_explicit(&q->dequeue_pos,
+					  memory_order_relaxed);
+	struct mpmc_cell *cell;
+
+	for (;;) {
+		size_t seq;
+		intptr_t diff;
+
+		cell = &q->cells[pos & q->mask];
+		seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+		diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(
+					&q->dequeue_pos, &pos, pos + 1,
+					memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		} else if (diff < 0) {
+			/* the producer of pos has not been here yet */
+			return false;
+		} else {
+			pos = atomic_load_explicit(&q->dequeue_pos,
+						   memory_order_relaxed);
+		}
+	}
+
+	*v = cell->data;
+	/* free the cell for the producer of pos + size */
+	atomic_store_explicit(&cell->seq, pos + q->mask + 1,
+			      memory_order_release);
+	return true;
+}
+
+#endif /* __MPMC_QUEUE_H */
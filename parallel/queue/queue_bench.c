@@ -0,0 +1,627 @@
+/*
+ * queue_bench.c - throughput and latency of the SPSC ring and the MPMC
+ * queue with the producer and the consumer on the same core (SMT
+ * siblings), on different cores of the same socket and across sockets
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "spsc_ring.h"
+#include "mpmc_queue.h"
+
+#define NSEC_IN_SEC	1000000000ULL
+#define MAX_THREADS	256
+/* spin that many times on full/empty before yielding the CPU */
+#define SPIN_LIMIT	1024
+
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+struct placement {
+	const char *name;
+	int cpu[2];
+};
+
+struct bench {
+	struct spsc_ring ring[2];
+	struct mpmc_queue queue[2];
+	_Atomic int nr_ready;
+	_Atomic bool start;
+	_Atomic uint64_t sum;
+	bool failed;
+};
+
+struct worker {
+	pthread_t tid;
+	void *(*fn)(void *arg);
+	int cpu;
+	int id;
+};
+
+static struct bench bench;
+static struct worker workers[MAX_THREADS];
+static int cpu_list[CPU_SETSIZE];
+static int nr_cpus;
+
+static size_t nr_items = 10000000;
+static size_t nr_pings = 1000000;
+static size_t batch = 32;
+static size_t capacity = 1024;
+static int nr_producers;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static inline void backoff(unsigned int *spins)
+{
+	if (++*spins < SPIN_LIMIT) {
+		cpu_relax();
+	} else {
+		*spins = 0;
+		sched_yield();
+	}
+}
+
+static void wait_start(void)
+{
+	unsigned int spins = 0;
+
+	atomic_fetch_add(&bench.nr_ready, 1);
+	while (!atomic_load_explicit(&bench.start, memory_order_acquire))
+		backoff(&spins);
+}
+
+static void *spsc_producer(void *arg)
+{
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = 0; i < nr_items; i++) {
+		while (!spsc_push(&bench.ring[0], (void *)i))
+			backoff(&spins);
+	}
+
+	return NULL;
+}
+
+static void *spsc_consumer(void *arg)
+{
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = 0; i < nr_items; i++) {
+		void *v;
+
+		while (!spsc_pop(&bench.ring[0], &v))
+			backoff(&spins);
+
+		if ((size_t)v != i) {
+			bench.failed = true;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *spsc_batch_producer(void *arg)
+{
+	unsigned int spins = 0;
+	void *v[batch];
+	size_t i = 0, n, k;
+
+	wait_start();
+
+	while (i < nr_items) {
+		n = nr_items - i < batch ? nr_items - i : batch;
+		for (k = 0; k < n; k++)
+			v[k] = (void *)(i + k);
+
+		k = 0;
+		while (k < n) {
+			size_t pushed = spsc_push_n(&bench.ring[0], v + k,
+						    n - k);
+
+			if (!pushed)
+				backoff(&spins);
+			k += pushed;
+		}
+		i += n;
+	}
+
+	return NULL;
+}
+
+static void *spsc_batch_consumer(void *arg)
+{
+	unsigned int spins = 0;
+	void *v[batch];
+	size_t i = 0, n, k;
+
+	wait_start();
+
+	while (i < nr_items) {
+		n = spsc_pop_n(&bench.ring[0], v, batch);
+		if (!n) {
+			backoff(&spins);
+			continue;
+		}
+
+		for (k = 0; k < n; k++) {
+			if ((size_t)v[k] != i + k) {
+				bench.failed = true;
+				return NULL;
+			}
+		}
+		i += n;
+	}
+
+	return NULL;
+}
+
+/* the items are split between the producers, consumers check the sum */
+static void *mpmc_producer(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = w->id; i < nr_items; i += nr_producers) {
+		while (!mpmc_push(&bench.queue[0], (void *)i))
+			backoff(&spins);
+	}
+
+	return NULL;
+}
+
+static void *mpmc_consumer(void *arg)
+{
+	unsigned int spins = 0;
+	uint64_t sum = 0;
+
+	wait_start();
+
+	for (;;) {
+		void *v;
+
+		while (!mpmc_pop(&bench.queue[0], &v))
+			backoff(&spins);
+
+		/* nr_items is the stop marker, one per consumer */
+		if ((size_t)v == nr_items)
+			break;
+		sum += (size_t)v;
+	}
+
+	atomic_fetch_add(&bench.sum, sum);
+	return NULL;
+}
+
+/* ping-pong: one item in flight, the round trip is two handoffs */
+static void *spsc_ping(void *arg)
+{
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = 0; i < nr_pings; i++) {
+		void *v;
+
+		while (!spsc_push(&bench.ring[0], (void *)i))
+			backoff(&spins);
+		while (!spsc_pop(&bench.ring[1], &v))
+			backoff(&spins);
+
+		if ((size_t)v != i) {
+			bench.failed = true;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *spsc_pong(void *arg)
+{
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = 0; i < nr_pings; i++) {
+		void *v;
+
+		while (!spsc_pop(&bench.ring[0], &v))
+			backoff(&spins);
+		while (!spsc_push(&bench.ring[1], v))
+			backoff(&spins);
+	}
+
+	return NULL;
+}
+
+static void *mpmc_ping(void *arg)
+{
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = 0; i < nr_pings; i++) {
+		void *v;
+
+		while (!mpmc_push(&bench.queue[0], (void *)i))
+			backoff(&spins);
+		while (!mpmc_pop(&bench.queue[1], &v))
+			backoff(&spins);
+
+		if ((size_t)v != i) {
+			bench.failed = true;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *mpmc_pong(void *arg)
+{
+	unsigned int spins = 0;
+	size_t i;
+
+	wait_start();
+
+	for (i = 0; i < nr_pings; i++) {
+		void *v;
+
+		while (!mpmc_pop(&bench.queue[0], &v))
+			backoff(&spins);
+		while (!mpmc_push(&bench.queue[1], v))
+			backoff(&spins);
+	}
+
+	return NULL;
+}
+
+static int bench_init(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (spsc_ring_init(&bench.ring[i], capacity) ||
+		    mpmc_queue_init(&bench.queue[i], capacity))
+			return -1;
+	}
+
+	atomic_init(&bench.nr_ready, 0);
+	atomic_init(&bench.start, false);
+	atomic_init(&bench.sum, 0);
+	bench.failed = false;
+	return 0;
+}
+
+static void bench_free(void)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		spsc_ring_free(&bench.ring[i]);
+		mpmc_queue_free(&bench.queue[i]);
+	}
+}
+
+/* run the workers, returns the time from the start to the last join */
+static uint64_t run_workers(int nr)
+{
+	pthread_attr_t attr;
+	uint64_t t0, t1;
+	cpu_set_t cpus;
+	int i;
+
+	if (bench_init()) {
+		fprintf(stderr, "Failed to allocate the queues\n");
+		return 0;
+	}
+
+	pthread_attr_init(&attr);
+
+	for (i = 0; i < nr; i++) {
+		struct worker *w = &workers[i];
+
+		CPU_ZERO(&cpus);
+		CPU_SET(w->cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+		if (pthread_create(&w->tid, &attr, w->fn, w)) {
+			fprintf(stderr, "Failed create thread %d\n", i);
+			/* the started ones would wait for the rest forever */
+			exit(-1);
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+
+	while (atomic_load(&bench.nr_ready) < nr)
+		sched_yield();
+
+	t0 = now_ns();
+	atomic_store_explicit(&bench.start, true, memory_order_release);
+
+	/* the MPMC consumers stop on the markers after the producers */
+	for (i = 0; i < nr; i++) {
+		if (workers[i].fn == mpmc_producer)
+			pthread_join(workers[i].tid, NULL);
+	}
+	for (i = 0; i < nr; i++) {
+		if (workers[i].fn == mpmc_consumer) {
+			while (!mpmc_push(&bench.queue[0], (void *)nr_items))
+				sched_yield();
+		}
+	}
+	for (i = 0; i < nr; i++) {
+		if (workers[i].fn != mpmc_producer)
+			pthread_join(workers[i].tid, NULL);
+	}
+	t1 = now_ns();
+
+	bench_free();
+
+	if (bench.failed) {
+		fprintf(stderr, "Wrong items received\n");
+		return 0;
+	}
+
+	return t1 > t0 ? t1 - t0 : 1;
+}
+
+/* Mops/s of moving nr_items from a to b */
+static double run_throughput(void *(*producer)(void *),
+			     void *(*consumer)(void *), int cpu_a, int cpu_b)
+{
+	uint64_t ns;
+
+	workers[0] = (struct worker) { .fn = producer, .cpu = cpu_a, .id = 0 };
+	workers[1] = (struct worker) { .fn = consumer, .cpu = cpu_b, .id = 1 };
+	nr_producers = 1;
+
+	ns = run_workers(2);
+	if (!ns)
+		return -1;
+
+	if (consumer == mpmc_consumer &&
+	    atomic_load(&bench.sum) != (uint64_t)nr_items * (nr_items - 1) / 2) {
+		fprintf(stderr, "Wrong MPMC sum\n");
+		return -1;
+	}
+
+	return (double)nr_items * 1000 / ns;
+}
+
+/* ns of one handoff, half of the round trip */
+static double run_latency(void *(*ping)(void *), void *(*pong)(void *),
+			  int cpu_a, int cpu_b)
+{
+	uint64_t ns;
+
+	workers[0] = (struct worker) { .fn = ping, .cpu = cpu_a };
+	workers[1] = (struct worker) { .fn = pong, .cpu = cpu_b };
+
+	ns = run_workers(2);
+	if (!ns)
+		return -1;
+
+	return (double)ns / nr_pings / 2;
+}
+
+static int read_topology(int cpu, const char *name)
+{
+	char path[128];
+	FILE *f;
+	int val = -1;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%d", &val) != 1)
+		val = -1;
+	fclose(f);
+
+	return val;
+}
+
+static int get_cpus(void)
+{
+	cpu_set_t cpus;
+	int cpu;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus))
+		return -1;
+
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &cpus))
+			cpu_list[nr_cpus++] = cpu;
+	}
+
+	return nr_cpus ? 0 : -1;
+}
+
+/* pick the second CPU for each placement relative to the first one */
+static void find_placements(struct placement *p)
+{
+	int cpu0 = cpu_list[0];
+	int pkg0 = read_topology(cpu0, "physical_package_id");
+	int core0 = read_topology(cpu0, "core_id");
+	int i;
+
+	for (i = 0; i < 4; i++)
+		p[i].cpu[0] = cpu0;
+
+	p[0].name = "same-cpu";
+	p[0].cpu[1] = cpu0;
+	p[1].name = "same-core";
+	p[1].cpu[1] = -1;
+	p[2].name = "same-socket";
+	p[2].cpu[1] = -1;
+	p[3].name = "cross-socket";
+	p[3].cpu[1] = -1;
+
+	for (i = 1; i < nr_cpus; i++) {
+		int cpu = cpu_list[i];
+		int pkg = read_topology(cpu, "physical_package_id");
+		int core = read_topology(cpu, "core_id");
+		int k;
+
+		if (pkg != pkg0)
+			k = 3;
+		else if (core == core0)
+			k = 1;
+		else
+			k = 2;
+
+		if (p[k].cpu[1] < 0)
+			p[k].cpu[1] = cpu;
+	}
+}
+
+static void usage(const char *prog)
+{
+	printf("usage: %s [-n items] [-l pings] [-c capacity] [-b batch] [-p producers]\n",
+	       prog);
+}
+
+int main(int argc, char **argv)
+{
+	struct placement places[4];
+	int producers = 0;
+	uint64_t ns;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "n:l:c:b:p:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_items = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			nr_pings = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			capacity = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			batch = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			producers = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (get_cpus()) {
+		fprintf(stderr, "Failed to get the CPUs\n");
+		return -1;
+	}
+
+	if (!nr_items || !nr_pings) {
+		fprintf(stderr, "Number of items and pings must be positive\n");
+		return -1;
+	}
+
+	if (!batch) {
+		fprintf(stderr, "Batch must be positive\n");
+		return -1;
+	}
+
+	if (capacity < 2 || (capacity & (capacity - 1))) {
+		fprintf(stderr, "Capacity must be a power of 2\n");
+		return -1;
+	}
+
+	if (!producers)
+		producers = nr_cpus / 2 ? nr_cpus / 2 : 1;
+	if (2 * producers > MAX_THREADS) {
+		fprintf(stderr, "Too many producers\n");
+		return -1;
+	}
+
+	find_placements(places);
+
+	printf("%zu items, %zu pings, capacity %zu, batch %zu\n", nr_items,
+	       nr_pings, capacity, batch);
+	printf("%-14s %-9s %10s %10s %10s %10s %10s\n", "", "cpus",
+	       "spsc", "spsc-batch", "mpmc", "spsc", "mpmc");
+	printf("%-14s %-9s %10s %10s %10s %10s %10s\n", "", "",
+	       "Mops/s", "Mops/s", "Mops/s", "ns", "ns");
+
+	for (i = 0; i < 4; i++) {
+		int a = places[i].cpu[0], b = places[i].cpu[1];
+		char cpus[32];
+		double r[5];
+
+		if (b < 0) {
+			printf("%-14s n/a\n", places[i].name);
+			continue;
+		}
+
+		r[0] = run_throughput(spsc_producer, spsc_consumer, a, b);
+		r[1] = run_throughput(spsc_batch_producer, spsc_batch_consumer,
+				      a, b);
+		r[2] = run_throughput(mpmc_producer, mpmc_consumer, a, b);
+		r[3] = run_latency(spsc_ping, spsc_pong, a, b);
+		r[4] = run_latency(mpmc_ping, mpmc_pong, a, b);
+
+		if (r[0] < 0 || r[1] < 0 || r[2] < 0 || r[3] < 0 || r[4] < 0)
+			return -1;
+
+		snprintf(cpus, sizeof(cpus), "%d,%d", a, b);
+		printf("%-14s %-9s %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		       places[i].name, cpus, r[0], r[1], r[2], r[3], r[4]);
+	}
+
+	/* all the CPUs: producers and consumers round robin */
+	for (i = 0; i < 2 * producers; i++) {
+		workers[i] = (struct worker) {
+			.fn = i % 2 ? mpmc_consumer : mpmc_producer,
+			.cpu = cpu_list[i % nr_cpus],
+			.id = i / 2,
+		};
+	}
+	nr_producers = producers;
+
+	ns = run_workers(2 * producers);
+	if (!ns)
+		return -1;
+	if (atomic_load(&bench.sum) != (uint64_t)nr_items * (nr_items - 1) / 2) {
+		fprintf(stderr, "Wrong MPMC sum\n");
+		return -1;
+	}
+
+	printf("\nmpmc %dP/%dC: %.1f Mops/s\n", producers, producers,
+	       (double)nr_items * 1000 / ns);
+	return 0;
+}
@@ -0,0 +1,117 @@
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+/*
+ * Bounded single producer single consumer ring of pointers.
+ *
+ * head and tail are free running indexes, each written by one side only
+ * and kept in its own cache line. Each side also keeps a cached copy of
+ * the other side's index and only reloads it (pulling the cache line over)
+ * when the ring looks full or empty with the cached value.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#define SPSC_CACHE_LINE	64
+
+struct spsc_ring {
+	/* producer side */
+	_Atomic size_t head __attribute__((aligned(SPSC_CACHE_LINE)));
+	size_t tail_cache;
+
+	/* consumer side */
+	_Atomic size_t tail __attribute__((aligned(SPSC_CACHE_LINE)));
+	size_t head_cache;
+
+	/* read only */
+	void **slots __attribute__((aligned(SPSC_CACHE_LINE)));
+	size_t size;
+	size_t mask;
+};
+
+/* size must be a power of 2 */
+static inline int spsc_ring_init(struct spsc_ring *r, size_t size)
+{
+	if (!size || (size & (size - 1)))
+		return -1;
+
+	r->slots = calloc(size, sizeof(*r->slots));
+	if (!r->slots)
+		return -1;
+
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	r->tail_cache = 0;
+	r->head_cache = 0;
+	r->size = size;
+	r->mask = size - 1;
+	return 0;
+}
+
+static inline void spsc_ring_free(struct spsc_ring *r)
+{
+	free(r->slots);
+	r->slots = NULL;
+}
+
+/* push up to n pointers, returns how many were pushed */
+static inline size_t spsc_push_n(struct spsc_ring *r, void * const *v,
+				 size_t n)
+{
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	size_t room = r->size - (head - r->tail_cache);
+	size_t i;
+
+	if (room < n) {
+		r->tail_cache = atomic_load_explicit(&r->tail,
+						     memory_order_acquire);
+		room = r->size - (head - r->tail_cache);
+		if (room < n)
+			n = room;
+	}
+
+	for (i = 0; i < n; i++)
+		r->slots[(head + i) & r->mask] = v[i];
+
+	/* publish the slots */
+	atomic_store_explicit(&r->head, head + n, memory_order_release);
+	return n;
+}
+
+/* pop up to n pointers, returns how many were popped */
+static inline size_t spsc_pop_n(struct spsc_ring *r, void **v, size_t n)
+{
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	size_t avail = r->head_cache - tail;
+	size_t i;
+
+	if (avail < n) {
+		r->head_cache = atomic_load_explicit(&r->head,
+						     memory_order_acquire);
+		avail = r->head_cache - tail;
+		if (avail < n)
+			n = avail;
+	}
+
+	for (i = 0; i < n; i++)
+		v[i] = r->slots[(tail + i) & r->mask];
+
+	/* hand the slots back to the producer */
+	atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+	return n;
+}
+
+static inline bool spsc_push(struct spsc_ring *r, void *v)
+{
+	return spsc_push_n(r, &v, 1);
+}
+
+static inline bool spsc_pop(struct spsc_ring *r, void **v)
+{
+	return spsc_pop_n(r, v, 1);
+}
+
+#endif /* __SPSC_RING_H */
@@ -1,59 +1,478 @@
+/*
+ * reorder.c - single producer / single consumer message handoff study
+ *
+ * The producer fills a message (sequence number, timestamp and a few data
+ * words all equal to the sequence number) and publishes it, the consumer
+ * waits for it and checks every word. A word which does not match the
+ * expected sequence number is reported as stale (older message) or early
+ * (the producer already overwrote it with the next one).
+ *
+ * Publication protocols:
+ *
+ *   relaxed    - one flag, all accesses relaxed: nothing orders the message
+ *                against the flag, so stale values are allowed (the
+ *                compiler or a weakly ordered CPU may expose them)
+ *   rel-acq    - one flag, store-release / load-acquire: the minimal
+ *                correct protocol
+ *   seq_cst    - one flag, sequentially consistent accesses
+ *   seq-slots  - ring of slots, each with its own sequence number which is
+ *                the publication flag, the producer can run ahead
+ *
+ * Message words are relaxed atomics in all modes so the races are well
+ * defined and only the flag ordering decides what the consumer sees.
+ */
+
+#define _GNU_SOURCE
 #include <stdio.h>
-#include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
 #include <pthread.h>
 
-#define MAX_COUNT	100000
+#define NSEC_IN_SEC	1000000000ULL
+#define CACHE_LINE	64
+#define NR_WORDS	4
+/* stale values printed per mode, all of them are counted */
+#define MAX_REPORTS	8
+/* spin that many times before yielding the CPU */
+#define SPIN_LIMIT	1024
+
+#define cpu_relax() __asm__ __volatile__("pause" ::: "memory")
+
+struct msg {
+	_Atomic uint64_t seq;
+	_Atomic uint64_t stamp;
+	_Atomic uint64_t data[NR_WORDS];
+};
+
+struct slot {
+	_Atomic uint64_t turn;
+	struct msg msg;
+} __attribute__((aligned(CACHE_LINE)));
+
+struct report {
+	uint64_t item;
+	int word;
+	uint64_t value;
+};
+
+struct result {
+	uint64_t stale;
+	uint64_t early;
+	uint64_t lat_sum;
+	uint64_t lat_max;
+	int nr_reports;
+	struct report reports[MAX_REPORTS];
+};
+
+struct handoff_mode {
+	const char *name;
+	void *(*producer)(void *arg);
+	void *(*consumer)(void *arg);
+};
 
-volatile static bool may_exit = false;
-volatile static bool is_done = false;
-volatile static int value;
-static int count1, count2;
+static struct {
+	_Atomic int flag __attribute__((aligned(CACHE_LINE)));
+	struct msg msg __attribute__((aligned(CACHE_LINE)));
+	struct slot *slots;
+	size_t nr_slots;
+	_Atomic int nr_ready;
+	_Atomic bool start;
+	struct result res;
+} shared;
 
-static int stats[100000] = {0};
+static uint64_t nr_items = 1000000;
 
-static void *thread1(void *arg) {
-	while (count2++ < MAX_COUNT) {
-		is_done = true;
-		value = 10;
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static inline void backoff(unsigned int *spins)
+{
+	if (++*spins < SPIN_LIMIT) {
+		cpu_relax();
+	} else {
+		*spins = 0;
+		sched_yield();
+	}
+}
+
+static void wait_start(void)
+{
+	unsigned int spins = 0;
+
+	atomic_fetch_add(&shared.nr_ready, 1);
+	while (!atomic_load_explicit(&shared.start, memory_order_acquire))
+		backoff(&spins);
+}
+
+static inline void msg_write(struct msg *m, uint64_t seq)
+{
+	int k;
+
+	atomic_store_explicit(&m->seq, seq, memory_order_relaxed);
+	for (k = 0; k < NR_WORDS; k++)
+		atomic_store_explicit(&m->data[k], seq, memory_order_relaxed);
+	atomic_store_explicit(&m->stamp, now_ns(), memory_order_relaxed);
+}
+
+static void record(struct result *res, uint64_t item, int word, uint64_t v)
+{
+	if (v < item)
+		res->stale++;
+	else
+		res->early++;
+
+	if (res->nr_reports < MAX_REPORTS)
+		res->reports[res->nr_reports++] = (struct report) {
+			.item = item, .word = word, .value = v,
+		};
+}
+
+/* check every word against the expected sequence number */
+static inline void msg_check(struct result *res, struct msg *m, uint64_t item)
+{
+	uint64_t v, stamp, lat, now;
+	int k;
+
+	v = atomic_load_explicit(&m->seq, memory_order_relaxed);
+	if (v != item)
+		record(res, item, -1, v);
+	for (k = 0; k < NR_WORDS; k++) {
+		v = atomic_load_explicit(&m->data[k], memory_order_relaxed);
+		if (v != item)
+			record(res, item, k, v);
+	}
+
+	stamp = atomic_load_explicit(&m->stamp, memory_order_relaxed);
+	now = now_ns();
+	lat = now > stamp ? now - stamp : 0;
+	res->lat_sum += lat;
+	if (lat > res->lat_max)
+		res->lat_max = lat;
+}
+
+/*
+ * One message in flight: the producer waits for the flag to be cleared,
+ * fills the message and sets the flag, the consumer waits for the flag,
+ * checks the message and clears the flag. The orders must be constants
+ * for the atomics to be compiled as requested, hence the macro.
+ */
+#define DEFINE_FLAG_HANDOFF(name, load_order, store_order)		\
+static void *name##_producer(void *arg)					\
+{									\
+	unsigned int spins = 0;						\
+	uint64_t i;							\
+									\
+	wait_start();							\
+									\
+	for (i = 1; i <= nr_items; i++) {				\
+		while (atomic_load_explicit(&shared.flag, load_order))	\
+			backoff(&spins);				\
+		msg_write(&shared.msg, i);				\
+		atomic_store_explicit(&shared.flag, 1, store_order);	\
+	}								\
+									\
+	return NULL;							\
+}									\
+									\
+static void *name##_consumer(void *arg)					\
+{									\
+	struct result *res = &shared.res;				\
+	unsigned int spins = 0;						\
+	uint64_t i;							\
+									\
+	wait_start();							\
+									\
+	for (i = 1; i <= nr_items; i++) {				\
+		while (!atomic_load_explicit(&shared.flag, load_order))	\
+			backoff(&spins);				\
+		msg_check(res, &shared.msg, i);				\
+		atomic_store_explicit(&shared.flag, 0, store_order);	\
+	}								\
+									\
+	return NULL;							\
+}
+
+DEFINE_FLAG_HANDOFF(relaxed, memory_order_relaxed, memory_order_relaxed)
+DEFINE_FLAG_HANDOFF(rel_acq, memory_order_acquire, memory_order_release)
+DEFINE_FLAG_HANDOFF(seq_cst, memory_order_seq_cst, memory_order_seq_cst)
+
+/*
+ * Slot i % nr_slots is free for item i when its turn is i - 1 and holds
+ * item i when its turn is i. The consumer gives it back by setting the turn
+ * to the one the producer expects for item i + nr_slots.
+ */
+static void *slots_producer(void *arg)
+{
+	size_t mask = shared.nr_slots - 1;
+	unsigned int spins = 0;
+	uint64_t i;
+
+	wait_start();
+
+	for (i = 1; i <= nr_items; i++) {
+		struct slot *s = &shared.slots[i & mask];
+		uint64_t free_turn = i - 1;
+
+		while (atomic_load_explicit(&s->turn, memory_order_acquire) !=
+		       free_turn)
+			backoff(&spins);
+		msg_write(&s->msg, i);
+		atomic_store_explicit(&s->turn, i, memory_order_release);
 	}
 
 	return NULL;
 }
 
-static void *thread2(void *arg) {
-	while (count1 < MAX_COUNT && !may_exit) {
-		while (!is_done && !may_exit)
-			;
+static void *slots_consumer(void *arg)
+{
+	struct result *res = &shared.res;
+	size_t mask = shared.nr_slots - 1;
+	unsigned int spins = 0;
+	uint64_t i;
+
+	wait_start();
 
-		if (may_exit)
-			return NULL;
+	for (i = 1; i <= nr_items; i++) {
+		struct slot *s = &shared.slots[i & mask];
 
-		stats[count2] = value;
-		is_done = false;
-		value = 11;
+		while (atomic_load_explicit(&s->turn, memory_order_acquire) != i)
+			backoff(&spins);
+		msg_check(res, &s->msg, i);
+		/* the producer takes it back as item i + nr_slots */
+		atomic_store_explicit(&s->turn, i - 1 + shared.nr_slots,
+				      memory_order_release);
 	}
 
 	return NULL;
 }
 
-int main(int argc, char **argv)
+static const struct handoff_mode modes[] = {
+	{ "relaxed", relaxed_producer, relaxed_consumer },
+	{ "rel-acq", rel_acq_producer, rel_acq_consumer },
+	{ "seq_cst", seq_cst_producer, seq_cst_consumer },
+	{ "seq-slots", slots_producer, slots_consumer },
+};
+
+static int shared_init(size_t nr_slots)
+{
+	size_t i;
+
+	shared.slots = aligned_alloc(CACHE_LINE,
+				     nr_slots * sizeof(*shared.slots));
+	if (!shared.slots)
+		return -1;
+	memset(shared.slots, 0, nr_slots * sizeof(*shared.slots));
+
+	/* the producer's first lap expects turn == item - 1 */
+	for (i = 0; i < nr_slots; i++)
+		atomic_init(&shared.slots[i].turn,
+			    i ? i - 1 : nr_slots - 1);
+
+	shared.nr_slots = nr_slots;
+	atomic_init(&shared.flag, 0);
+	memset(&shared.msg, 0, sizeof(shared.msg));
+	atomic_init(&shared.nr_ready, 0);
+	atomic_init(&shared.start, false);
+	memset(&shared.res, 0, sizeof(shared.res));
+
+	return 0;
+}
+
+static int start_thread(pthread_t *tid, void *(*fn)(void *), int cpu)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int err;
+
+	pthread_attr_init(&attr);
+	if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+
+	err = pthread_create(tid, &attr, fn, NULL);
+	pthread_attr_destroy(&attr);
+
+	return err ? -1 : 0;
+}
+
+/* returns the elapsed ns, the findings are in shared.res */
+static uint64_t run_mode(const struct handoff_mode *m, size_t nr_slots,
+			 int cpu_prod, int cpu_cons)
+{
+	pthread_t prod, cons;
+	uint64_t t0, t1;
+
+	if (shared_init(nr_slots)) {
+		fprintf(stderr, "Failed to allocate the slots\n");
+		return 0;
+	}
+
+	if (start_thread(&cons, m->consumer, cpu_cons)) {
+		fprintf(stderr, "Failed to create the consumer\n");
+		free(shared.slots);
+		return 0;
+	}
+	if (start_thread(&prod, m->producer, cpu_prod)) {
+		fprintf(stderr, "Failed to create the producer\n");
+		/* let the consumer run through an empty stream */
+		nr_items = 0;
+		atomic_store_explicit(&shared.start, true, memory_order_release);
+		pthread_join(cons, NULL);
+		free(shared.slots);
+		return 0;
+	}
+
+	while (atomic_load(&shared.nr_ready) < 2)
+		sched_yield();
+
+	t0 = now_ns();
+	atomic_store_explicit(&shared.start, true, memory_order_release);
+
+	pthread_join(prod, NULL);
+	pthread_join(cons, NULL);
+	t1 = now_ns();
+
+	free(shared.slots);
+
+	return t1 > t0 ? t1 - t0 : 1;
+}
+
+static void print_reports(const struct result *res)
 {
-	pthread_t tid1, tid2;
 	int i;
 
-	pthread_create(&tid1, NULL, thread1, NULL);
-	pthread_create(&tid2, NULL, thread2, NULL);
+	for (i = 0; i < res->nr_reports; i++) {
+		const struct report *r = &res->reports[i];
+
+		if (r->word < 0)
+			printf("    item %lu: seq is %lu\n", r->item, r->value);
+		else
+			printf("    item %lu: data[%d] is %lu\n", r->item,
+			       r->word, r->value);
+	}
+}
+
+static int get_cpu(int nth)
+{
+	cpu_set_t cpus;
+	int cpu, n = 0, last = -1;
 
-	pthread_join(tid1, NULL);
-	may_exit = true;
-	pthread_join(tid2, NULL);
+	if (sched_getaffinity(0, sizeof(cpus), &cpus))
+		return -1;
 
-	for (i = 0; i < MAX_COUNT - 1; i++) {
-		if (stats[i] == 11)
-			printf("stats[%d] is reordered\n", i);
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &cpus))
+			continue;
+		if (n++ == nth)
+			return cpu;
+		last = cpu;
 	}
 
-	return 0;
+	/* not enough CPUs, share the last one */
+	return last;
+}
+
+static void usage(const char *prog)
+{
+	size_t i;
+
+	printf("usage: %s [-n items] [-s slots] [-m mode] [-p producer cpu] [-c consumer cpu]\n",
+	       prog);
+	printf("  modes:");
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
+		printf(" %s", modes[i].name);
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int cpu_prod = -1, cpu_cons = -1;
+	const char *only = NULL;
+	size_t nr_slots = 64;
+	bool failed = false;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:s:m:p:c:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_items = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			nr_slots = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			only = optarg;
+			break;
+		case 'p':
+			cpu_prod = atoi(optarg);
+			break;
+		case 'c':
+			cpu_cons = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : -1;
+		}
+	}
+
+	if (!nr_items) {
+		fprintf(stderr, "Number of items must be positive\n");
+		return -1;
+	}
+
+	if (nr_slots < 2 || (nr_slots & (nr_slots - 1))) {
+		fprintf(stderr, "Slots must be a power of 2\n");
+		return -1;
+	}
+
+	if (cpu_prod < 0)
+		cpu_prod = get_cpu(0);
+	if (cpu_cons < 0)
+		cpu_cons = get_cpu(1);
+
+	printf("%lu items, %zu slots, producer cpu %d, consumer cpu %d\n",
+	       nr_items, nr_slots, cpu_prod, cpu_cons);
+	printf("%-10s %10s %10s %10s %10s %10s %10s\n", "mode", "Mops/s",
+	       "ns/item", "lat avg", "lat max", "stale", "early");
+
+	for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+		const struct handoff_mode *m = &modes[i];
+		struct result *res = &shared.res;
+		uint64_t ns;
+
+		if (only && strcmp(only, m->name))
+			continue;
+
+		ns = run_mode(m, nr_slots, cpu_prod, cpu_cons);
+		if (!ns)
+			return -1;
+
+		printf("%-10s %10.2f %10.1f %10.1f %10lu %10lu %10lu\n",
+		       m->name, (double)nr_items * 1000 / ns,
+		       (double)ns / nr_items,
+		       (double)res->lat_sum / nr_items, res->lat_max,
+		       res->stale, res->early);
+		print_reports(res);
+
+		/* only the relaxed protocol is allowed to expose them */
+		if (m->producer != relaxed_producer &&
+		    (res->stale || res->early))
+			failed = true;
+	}
+
+	return failed ? -1 : 0;
 }